@@ -7,6 +7,25 @@
 #include <string>
 #include <vector>
 #include <cmath>
+#include <unordered_map>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <list>
+#include <limits>
+#include <cstdint>
+#include <mutex>
+#include <condition_variable>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <csignal>
+#include <cerrno>
+#endif
 
 using namespace std;
 
@@ -29,10 +48,12 @@ enum TokenType {
 struct Token {
     TokenType type; // only used for constants
     double value; // ints are converted to doubles too
+    size_t index = 0; // only used for variables: position of the name in the variable list
 };
 
 const char VARIABLE = 'x';
 const char DECIMALSEPARATOR = '.';
+const vector<string> DEFAULTVARIABLES = { string(1, VARIABLE) }; // the kata only knows x
 
 class Lexer {
 private:
@@ -80,28 +101,28 @@ private:
         return (double)integerPart + fractionPart;
     }
 
-    string makeFunction() {
-        string functionType = "";
-        while (isAlpha(eq[pos])) {
-            functionType += eq[pos];
+    // function names and variable names share the same syntax: a letter followed by letters or digits
+    string makeIdentifier() {
+        string identifier = "";
+        while (isAlpha(eq[pos]) || (identifier != "" && isDigit(eq[pos]))) {
+            identifier += eq[pos];
             ++pos;
         }
-        return functionType;
+        return identifier;
     }
 
     int parenBalance = 0;
 
+    vector<string> variables;
+
 public:
-    Lexer(const string& eq) : eq(eq), pos(0) {}
+    Lexer(const string& eq, const vector<string>& variables = DEFAULTVARIABLES) : eq(eq), pos(0), variables(variables) {}
 
     vector<Token> lex() {
         vector<Token> res;
         while (eq[pos] != '\0') {
             if (isDigit(eq[pos])) {
                 res.push_back(Token{ TokenType::Tconst, makeNum() });
-            } else if (eq[pos] == VARIABLE) {
-                res.push_back(Token{ TokenType::Tvariable, 0 });
-                ++pos;
             } else {
                 switch (eq[pos]) {
                 case '+':
@@ -133,8 +154,11 @@ public:
                     // just ignore space
                     break;
                 default:
-                    string functionType = makeFunction();
-                    if (functionType == "sin") {
+                    string functionType = makeIdentifier();
+                    size_t varIndex = find(variables.begin(), variables.end(), functionType) - variables.begin();
+                    if (varIndex < variables.size()) { // variables shadow function names
+                        res.push_back(Token{ TokenType::Tvariable, 0, varIndex });
+                    } else if (functionType == "sin") {
                         res.push_back(Token{ TokenType::Tsin, 0 });
                     } else if (functionType == "cos") {
                         res.push_back(Token{ TokenType::Tcos, 0 });
@@ -148,8 +172,8 @@ public:
                         res.push_back(Token{ TokenType::Tcosh, 0 });
                     } else if (functionType == "log") {
                         res.push_back(Token{ TokenType::Tlog, 0 });
-                    } else if (functionType != "") {
-                        throw "Lexer error: unknown character";
+                    } else {
+                        throw "Lexer error: unknown character or variable";
                     }
                 }
             } 
@@ -176,6 +200,8 @@ struct Node {
 
     Node* a; // used for left-hand-side of binary operations and for input argument of functions
     Node* b; // used for right-hand-side of binary operations
+
+    size_t index = 0; // only used for variables: position in the variable list
 };
 
 class Parser {
@@ -196,116 +222,122 @@ private:
         }
     }
 
-    Node* expr() {
-        Node* a = term();
-        while (toks[pos].type == TokenType::Tplus ||
-            toks[pos].type == TokenType::Tminus) {
-            TokenType tokType = toks[pos].type;
-            ++pos;
-            Node* b = term();
-            a = new Node{ NodeType::binaryOp, tokType, 0, a, b }; 
-        }
-        return a;
+    static bool isFunction(TokenType t) {
+        return (t == TokenType::Tsin) ||
+            (t == TokenType::Tcos) ||
+            (t == TokenType::Ttan) ||
+            (t == TokenType::Tcot) ||
+            (t == TokenType::Tsinh) ||
+            (t == TokenType::Tcosh) ||
+            (t == TokenType::Tlog);
     }
 
-    Node* term() {
-        Node* a = factor();
-        while (toks[pos].type == TokenType::Tmult ||
-            toks[pos].type == TokenType::Tdiv) {
-            TokenType tokType = toks[pos].type;
-            ++pos;
-            Node* b = factor();
-            a = new Node{ NodeType::binaryOp, tokType, 0, a, b };
+    // PEMDAS: <expression> combines terms, <term> combines factors, <factor> combines basics
+    static int precedence(TokenType t) {
+        switch (t) {
+        case TokenType::Tplus:
+        case TokenType::Tminus:
+            return 1;
+        case TokenType::Tmult:
+        case TokenType::Tdiv:
+            return 2;
+        case TokenType::Tpow:
+            return 3;
+        default:
+            return 0; // '(' and function calls are never reduced by an operator
         }
-        return a;
     }
 
-    Node* factor() {
-        Node* a = basic();
-        //while (toks[pos].type == TokenType::Tpow) {
-        if (toks[pos].type == TokenType::Tpow) {
-            TokenType tokType = toks[pos].type;
-            ++pos;
-            //Node* b = basic();
-            // Instead of looping through all ^ operators, the function makes a recursive call when encountering ^. This ensures that the right-hand side (e.g., b^c) is fully parsed before combining it with the left-hand side.
-            Node* b = factor(); // we use recursive call to the right here, because exponentiation operator is right-associative
-            a = new Node{ NodeType::binaryOp, tokType, 0, a, b };
-        }
-        return a;
-    }
-
-    Node* func_call() {
-        if (!((toks[pos].type == TokenType::Tsin) ||
-            (toks[pos].type == TokenType::Tcos) ||
-            (toks[pos].type == TokenType::Ttan) ||
-            (toks[pos].type == TokenType::Tcot) ||
-            (toks[pos].type == TokenType::Tsinh) ||
-            (toks[pos].type == TokenType::Tcosh) ||
-            (toks[pos].type == TokenType::Tlog))) {
-            throw "Parser error: expected function identifier";
-        }
-        TokenType funcType = toks[pos].type;
-        ++pos;
-        if (toks[pos].type != TokenType::TlParen) throw "Parser error: expected '(' after function identifier";
-        ++pos;
-        Node* arg = expr();
-        if (toks[pos].type != TokenType::TrParen) throw "Parser error: expected ')' after function argument";
-        ++pos;
-        checkToken();
-        return new Node{ NodeType::funcCall, funcType , 0, arg, nullptr };
-    }
-
-    Node* basic() {
-        if (toks[pos].type == TokenType::Tconst) {
-            Node* ret = new Node{ NodeType::constant, TokenType::Tconst, toks[pos].value, nullptr, nullptr };
-            ++pos;
-            checkToken();
-            return ret;
-        }
-        if (toks[pos].type == TokenType::Tvariable) {
-            Node* ret = new Node{ NodeType::variable, TokenType::Tvariable, 0, nullptr, nullptr};
-            ++pos;
-            checkToken();
-            return ret;
-        }
-        if ((toks[pos].type == TokenType::Tsin) ||
-            (toks[pos].type == TokenType::Tcos) ||
-            (toks[pos].type == TokenType::Ttan) ||
-            (toks[pos].type == TokenType::Tcot) ||
-            (toks[pos].type == TokenType::Tsinh) ||
-            (toks[pos].type == TokenType::Tcosh) ||
-            (toks[pos].type == TokenType::Tlog)) {
-            return func_call();
-        }
-        if (toks[pos].type == TokenType::TlParen) {
-            ++pos;
-            Node* ret = expr();
-            if (toks[pos].type != TokenType::TrParen) throw "Parser error: expected ')' after '('";
-            ++pos;
-            checkToken();
-            return ret;
-        }
-        throw "Parser error: unexpected token";
+    vector<Node*> operands;
+    vector<TokenType> operators; // binary operators, '(' and the function identifiers in front of their '('
+
+    void reduce() {
+        TokenType tokType = operators.back();
+        operators.pop_back();
+        Node* b = operands.back();
+        operands.pop_back();
+        operands.back() = new Node{ NodeType::binaryOp, tokType, 0, operands.back(), b };
     }
 
 public:
     Parser(const vector<Token>& tokens) : toks(tokens), pos(0) {}
 
+    // Precedence climbing with explicit stacks instead of one recursive call per '^', parenthesis and function call,
+    // so the nesting depth is only limited by memory. Builds the same tree as the grammar in the README.
     Node* parse() {
-        return expr();
+        operands.clear();
+        operators.clear();
+        bool expectOperand = true;
+        while (true) {
+            TokenType t = toks[pos].type;
+            if (expectOperand) {
+                if (t == TokenType::Tconst) {
+                    operands.push_back(new Node{ NodeType::constant, TokenType::Tconst, toks[pos].value, nullptr, nullptr });
+                    ++pos;
+                    checkToken();
+                    expectOperand = false;
+                } else if (t == TokenType::Tvariable) {
+                    operands.push_back(new Node{ NodeType::variable, TokenType::Tvariable, 0, nullptr, nullptr, toks[pos].index });
+                    ++pos;
+                    checkToken();
+                    expectOperand = false;
+                } else if (isFunction(t)) {
+                    ++pos;
+                    if (toks[pos].type != TokenType::TlParen) throw "Parser error: expected '(' after function identifier";
+                    ++pos;
+                    operators.push_back(t);
+                    operators.push_back(TokenType::TlParen);
+                } else if (t == TokenType::TlParen) {
+                    ++pos;
+                    operators.push_back(TokenType::TlParen);
+                } else {
+                    throw "Parser error: unexpected token";
+                }
+                continue;
+            }
+
+            if (t == TokenType::TEND || t == TokenType::TrParen) {
+                while (!operators.empty() && operators.back() != TokenType::TlParen) {
+                    reduce();
+                }
+                if (t == TokenType::TEND) {
+                    if (!operators.empty()) throw "Parser error: expected ')' after '('";
+                    return operands.back();
+                }
+                if (operators.empty()) throw "Parser error: unexpected token";
+                operators.pop_back(); // '('
+                if (!operators.empty() && isFunction(operators.back())) {
+                    operands.back() = new Node{ NodeType::funcCall, operators.back(), 0, operands.back(), nullptr };
+                    operators.pop_back();
+                }
+                ++pos;
+                checkToken();
+            } else {
+                // left-associative operators reduce the ones with the same precedence, ^ is right-associative (a^b^c is a^(b^c))
+                int p = precedence(t);
+                while (!operators.empty() && (precedence(operators.back()) > p ||
+                    (precedence(operators.back()) == p && t != TokenType::Tpow))) {
+                    reduce();
+                }
+                operators.push_back(t);
+                ++pos;
+                expectOperand = true;
+            }
+        }
     }
 };
 
-Node* diff(Node* root) {
+// Derivative of a single node, da and db are the derivatives of its operands (nullptr if it has none)
+Node* diffNode(Node* root, Node* da, Node* db, size_t varIndex) {
     switch (root->type) {
     case NodeType::constant: // c' = 0
         return new Node{ NodeType::constant, TokenType::Tconst, 0, nullptr, nullptr };
-    case NodeType::variable: // x' = 1  (3x is a multiplication, so it will be 3'x + 3x' == 3; this differentiation happens in multiplication, not here)
-        return new Node{ NodeType::constant, TokenType::Tconst, 1, nullptr, nullptr };
+    case NodeType::variable: // x' = 1  (3x is a multiplication, so it will be 3'x + 3x' == 3; this differentiation happens in multiplication, not here), y' = 0
+        return new Node{ NodeType::constant, TokenType::Tconst, root->index == varIndex ? 1.0 : 0.0, nullptr, nullptr };
     case NodeType::funcCall:
     {
         // f(x) = x' * f'(x)     (chain rule)
-        Node* res = new Node{ NodeType::binaryOp, TokenType::Tmult, 0, diff(root->a), nullptr };
+        Node* res = new Node{ NodeType::binaryOp, TokenType::Tmult, 0, da, nullptr };
         switch (root->tokType) {
         case TokenType::Tsin: // (sin(x))' = cos(x)
         {
@@ -398,23 +430,23 @@ Node* diff(Node* root) {
         switch (root->tokType) {
         case TokenType::Tplus: // (a+b)' = a' + b'
             return new Node{ NodeType::binaryOp, TokenType::Tplus, 0,
-                diff(root->a),
-                diff(root->b)
+                da,
+                db
             };
         case TokenType::Tminus: // (a - b)' = a' - b'
             return new Node{ NodeType::binaryOp, TokenType::Tminus, 0,
-                diff(root->a),
-                diff(root->b)
+                da,
+                db
             };
         case TokenType::Tmult: // (a * b)' = a' * b + a * b'
         {
             Node* left = new Node{ NodeType::binaryOp, TokenType::Tmult, 0,
-                diff(root->a),
+                da,
                 root->b
             };
             Node* right = new Node{ NodeType::binaryOp, TokenType::Tmult, 0,
                 root->a,
-                diff(root->b)
+                db
             };
             return new Node{ NodeType::binaryOp, TokenType::Tplus, 0,
                 left,
@@ -424,12 +456,12 @@ Node* diff(Node* root) {
         case TokenType::Tdiv: // (a / b)' = (a' * b - a * b') / b^2
         {
             Node* left = new Node{ NodeType::binaryOp, TokenType::Tmult, 0,
-                diff(root->a),
+                da,
                 root->b
             };
             Node* right = new Node{ NodeType::binaryOp, TokenType::Tmult, 0,
                 root->a,
-                diff(root->b)
+                db
             };
             Node* top = new Node{ NodeType::binaryOp, TokenType::Tminus, 0,
                 left,
@@ -463,11 +495,11 @@ Node* diff(Node* root) {
                 nullptr
             };
             Node* innerLeft = new Node{ NodeType::binaryOp, TokenType::Tmult, 0,
-                diff(root->b),
+                db,
                 logFunc
             };
             Node* div = new Node{ NodeType::binaryOp, TokenType::Tdiv, 0,
-                diff(root->a),
+                da,
                 root->a
             };
             Node* innerRight = new Node{ NodeType::binaryOp, TokenType::Tmult, 0,
@@ -491,245 +523,2745 @@ Node* diff(Node* root) {
     }
 }
 
-class Calculator {
+// Per-node bookkeeping of the walks over an expression: open addressing with linear probing, so unlike unordered_map
+// there is no allocation per node. Every walk below visits each node once and looks it up a few times, which made
+// the hashing the biggest part of building a tape.
+template <typename T>
+class NodeMap {
 private:
-    value_t substitutionValue;
-public:
-    Calculator(value_t substitutionValue) : substitutionValue(substitutionValue) {}
-    
-    value_t calc(Node* root) {
-        switch (root->type) {
-        case NodeType::constant:
-            return root->value;
-        case NodeType::variable:
-            return substitutionValue;
-        case NodeType::funcCall:
-            switch (root->tokType) {
-            case TokenType::Tsin:
-                return sin(calc(root->a));
-            case TokenType::Tcos:
-                return cos(calc(root->a));
-            case TokenType::Ttan:
-                return tan(calc(root->a)); // tangent never throws an error: tan(pi/2) should be undefined, but due to rounding we can never put pi/2 as ab argument
-            case TokenType::Tcot:
-            {
-                value_t tanValue = tan(calc(root->a));
-                if (tanValue == 0.0) throw "Calculator error: division by 0 (cot = 1 / tan)";
-                return 1.0 / tanValue;
-            }
-            case TokenType::Tsinh:
-                return sinh(calc(root->a));
-            case TokenType::Tcosh:
-                return cosh(calc(root->a));
-            case TokenType::Tlog:
-            {
-                value_t a = calc(root->a);
-                if (abs(a) <= 0.0) throw "Calculator error: log argument is outside of log's domain";
-                return log(a); // natural log (base e)
-            }
-            default:
-                throw "Calculator error: unknows funcCall TokenType";
-            }
-        case NodeType::binaryOp:
-            switch (root->tokType) {
-            case TokenType::Tplus:
-                return calc(root->a) + calc(root->b);
-            case TokenType::Tminus:
-                return calc(root->a) - calc(root->b);
-            case TokenType::Tmult:
-                return calc(root->a) * calc(root->b);
-            case TokenType::Tdiv:
-            {
-                value_t b = calc(root->b);
-                if (b == 0.0) throw "Calculator error: division by 0";
-                return calc(root->a) / b;
-            }
-            case TokenType::Tpow:
-                return pow(calc(root->a), calc(root->b));
-            default:
-                throw "Calculator error: unknows binaryOp TokenType";
-            }
-        default:
-            throw "Calculator error: unknows NodeType";
+    vector<const Node*> keys; // nullptr marks a free slot
+    vector<T> values;
+    size_t used = 0;
+    unsigned shift = 64 - 8; // the hash keeps the top log2(keys.size()) bits
+
+    size_t slot(const Node* key) const {
+        size_t i = static_cast<size_t>((static_cast<uint64_t>(reinterpret_cast<uintptr_t>(key)) * 0x9E3779B97F4A7C15ull) >> shift);
+        while (keys[i] != nullptr && keys[i] != key) {
+            i = (i + 1) & (keys.size() - 1);
+        }
+        return i;
+    }
+
+    void grow() {
+        vector<const Node*> oldKeys(keys.size() * 2, nullptr);
+        vector<T> oldValues(values.size() * 2);
+        oldKeys.swap(keys);
+        oldValues.swap(values);
+        --shift;
+        for (size_t i = 0; i < oldKeys.size(); ++i) {
+            if (oldKeys[i] == nullptr) continue;
+            size_t j = slot(oldKeys[i]);
+            keys[j] = oldKeys[i];
+            values[j] = oldValues[i];
         }
     }
+
+public:
+    NodeMap() : keys(256, nullptr), values(256) {}
+
+    // the value of key, set to init first if key is new (second is true then). The pointer is valid until the next insert.
+    pair<T*, bool> emplace(const Node* key, const T& init) {
+        if ((used + 1) * 2 > keys.size()) grow();
+        size_t i = slot(key);
+        if (keys[i] == key) return { &values[i], false };
+        keys[i] = key;
+        values[i] = init;
+        ++used;
+        return { &values[i], true };
+    }
+
+    // nullptr if key is not in the map
+    const T* find(const Node* key) const {
+        size_t i = slot(key);
+        return keys[i] == key ? &values[i] : nullptr;
+    }
+
+    const T& at(const Node* key) const {
+        const T* res = find(key);
+        if (res == nullptr) throw "NodeMap error: unknown node";
+        return *res;
+    }
 };
 
-tuple<func_t, func_t, func_t> differentiate(const string& eq) {
+// Every distinct node reachable from the roots, children before their parents.
+// Iterative, so the depth of the expression is only limited by memory.
+vector<Node*> postOrder(const vector<Node*>& roots) {
+    vector<Node*> res;
+    NodeMap<char> visited; // 0 while its children are still being visited
+    vector<Node*> stack(roots.rbegin(), roots.rend());
+    while (!stack.empty()) {
+        Node* node = stack.back();
+        auto it = visited.emplace(node, 0);
+        if (it.second) {
+            if (node->b != nullptr && visited.find(node->b) == nullptr) stack.push_back(node->b);
+            if (node->a != nullptr && visited.find(node->a) == nullptr) stack.push_back(node->a);
+        } else {
+            stack.pop_back();
+            if (*it.first == 0) {
+                *it.first = 1;
+                res.push_back(node);
+            }
+        }
+    }
+    return res;
+}
 
-    Lexer myLexer(eq);
-    vector<Token> myTokens = myLexer.lex();
+// Frees every distinct node reachable from the roots, so trees sharing nodes (like f and its derivatives) go together
+void deleteTrees(const vector<Node*>& roots) {
+    for (Node* node : postOrder(roots)) {
+        delete node;
+    }
+}
 
-    Parser myParser(myTokens);
-    Node* eqTree = myParser.parse(); // build abstract syntax tree
+// differentiates with respect to the variable at varIndex, every other variable is treated as a constant.
+// Subtrees shared by the input (diff() output shares a lot) are differentiated once and their derivative is shared too.
+// Walks like postOrder(); derivatives doubles as its visited set.
+Node* diff(Node* root, size_t varIndex = 0) {
+    NodeMap<Node*> derivatives; // nullptr while the children of the node are still being differentiated
+    vector<Node*> stack{ root };
+    while (!stack.empty()) {
+        Node* node = stack.back();
+        auto visited = derivatives.emplace(node, nullptr);
+        if (visited.second) {
+            if (node->b != nullptr && derivatives.find(node->b) == nullptr) stack.push_back(node->b);
+            if (node->a != nullptr && derivatives.find(node->a) == nullptr) stack.push_back(node->a);
+        } else {
+            stack.pop_back();
+            if (*visited.first == nullptr) {
+                Node* da = node->a != nullptr ? derivatives.at(node->a) : nullptr;
+                Node* db = node->b != nullptr ? derivatives.at(node->b) : nullptr;
+                *visited.first = diffNode(node, da, db, varIndex);
+            }
+        }
+    }
+    return derivatives.at(root);
+}
 
-    Node* firstDiffTree = diff(eqTree);
+const int MAXLOWEREDEXPONENT = 16;
 
-    Node* secondDiffTree = diff(firstDiffTree);
+// a^n as multiplications, by squaring, so a^n takes at most 2 * log2(n) of them (n >= 1)
+Node* integerPower(Node* a, int n) {
+    if (n == 1) return a;
+    Node* half = integerPower(a, n / 2);
+    Node* square = new Node{ NodeType::binaryOp, TokenType::Tmult, 0, half, half };
+    return n % 2 == 0 ? square : new Node{ NodeType::binaryOp, TokenType::Tmult, 0, square, a };
+}
 
-    return {
-        [eqTree](value_t substitutionValue) {
-            Calculator myCalculator(substitutionValue);
-            return myCalculator.calc(eqTree);
-        },
-        [firstDiffTree](value_t substitutionValue) {
-            Calculator myCalculator(substitutionValue);
-            return myCalculator.calc(firstDiffTree);
-        },
-        [secondDiffTree](value_t substitutionValue) {
-            Calculator myCalculator(substitutionValue);
-            return myCalculator.calc(secondDiffTree);
+// Same value with every a^n, n a constant integer from 1 to MAXLOWEREDEXPONENT, written as multiplications. Lowered before
+// diff(), a polynomial's derivatives stay + - * only: the pow rule writes (a^b)' with log(a) and a division by a.
+// Nodes whose subtree has no such pow are shared with the input.
+Node* lowerPowers(Node* root) {
+    NodeMap<Node*> lowered; // nullptr while the children of the node are still being lowered
+    vector<Node*> stack{ root };
+    while (!stack.empty()) {
+        Node* node = stack.back();
+        auto visited = lowered.emplace(node, nullptr);
+        if (visited.second) {
+            if (node->b != nullptr && lowered.find(node->b) == nullptr) stack.push_back(node->b);
+            if (node->a != nullptr && lowered.find(node->a) == nullptr) stack.push_back(node->a);
+            continue;
         }
-    };
+        stack.pop_back();
+        if (*visited.first != nullptr) continue;
+        Node* a = node->a != nullptr ? lowered.at(node->a) : nullptr;
+        Node* b = node->b != nullptr ? lowered.at(node->b) : nullptr;
+        Node* res = node;
+        if (node->type == NodeType::binaryOp && node->tokType == TokenType::Tpow && b->type == NodeType::constant &&
+            b->value == floor(b->value) && b->value >= 1 && b->value <= MAXLOWEREDEXPONENT) {
+            res = integerPower(a, static_cast<int>(b->value));
+        } else if (a != node->a || b != node->b) {
+            res = new Node(*node);
+            res->a = a;
+            res->b = b;
+        }
+        *visited.first = res;
+    }
+    return lowered.at(root);
 }
 
-// For testing
+// Every distinct node reachable from the roots as a flat list, children before their parents
+struct FlatEntry {
+    NodeType type;
+    TokenType tokType;
+    double value; // only used for constants
+    size_t index; // only used for variables
+    size_t a; // position of the left-hand-side or function argument
+    size_t b; // position of the right-hand-side
+};
 
-string double_to_str(double d) {
-    if (floor(d) == d) {
-        return to_string((int)d);
+// Shared subtrees (diff() produces a lot of them) get one entry, and so does every variable no matter how often it occurs:
+// variableAt[i] gets the position of variable i (npos if it does not occur), outputs the position of every root.
+vector<FlatEntry> flatten(const vector<Node*>& roots, vector<size_t>& variableAt, vector<size_t>& outputs) {
+    vector<FlatEntry> res;
+    NodeMap<size_t> recorded; // npos while the children of the node are still being recorded
+    fill(variableAt.begin(), variableAt.end(), string::npos);
+    vector<Node*> stack(roots.rbegin(), roots.rend());
+    while (!stack.empty()) {
+        Node* node = stack.back();
+        auto visited = recorded.emplace(node, string::npos);
+        if (visited.second) {
+            if (node->b != nullptr && recorded.find(node->b) == nullptr) stack.push_back(node->b);
+            if (node->a != nullptr && recorded.find(node->a) == nullptr) stack.push_back(node->a);
+            continue;
+        }
+        stack.pop_back();
+        if (*visited.first != string::npos) continue;
+        FlatEntry e{ node->type, node->tokType, node->value, node->index, 0, 0 };
+        switch (node->type) {
+        case NodeType::constant:
+            break;
+        case NodeType::variable:
+            if (node->index >= variableAt.size()) variableAt.resize(node->index + 1, string::npos);
+            if (variableAt[node->index] != string::npos) {
+                *visited.first = variableAt[node->index];
+                continue;
+            }
+            variableAt[node->index] = res.size();
+            break;
+        case NodeType::funcCall:
+            e.a = recorded.at(node->a);
+            break;
+        case NodeType::binaryOp:
+            e.a = recorded.at(node->a);
+            e.b = recorded.at(node->b);
+            break;
+        default:
+            throw "Flatten error: unknows NodeType";
+        }
+        *visited.first = res.size();
+        res.push_back(e);
     }
-    string res = to_string(d);
-    while (res.back() == '0') {
-        res.pop_back();
+    outputs.clear();
+    for (Node* root : roots) {
+        outputs.push_back(recorded.at(root));
     }
     return res;
 }
 
-string tokenTypeToStr(TokenType t) {
-    switch (t) {
-    case TokenType::Tconst:
-        return "constant";
-    case TokenType::Tvariable:
-        return "variable";
+// the value of a number without its derivative parts (see Dual and Jet)
+template <typename R>
+complex<R> primal(const complex<R>& a) { return a; }
+
+// Single operations, shared by every evaluator, in any precision and number type (V is a complex type, Dual or Jet).
+// Unchecked evaluation never throws, invalid operations give inf or nan instead (batch evaluators check the results per lane).
+
+template <typename V>
+V calcFuncCall(TokenType tokType, V a, bool checked = true) {
+    switch (tokType) {
     case TokenType::Tsin:
-        return "sin";
+        return sin(a);
     case TokenType::Tcos:
-        return "cos";
+        return cos(a);
     case TokenType::Ttan:
-        return "tan";
+        return tan(a); // tangent never throws an error: tan(pi/2) should be undefined, but due to rounding we can never put pi/2 as ab argument
     case TokenType::Tcot:
-        return "cot";
+    {
+        V tanValue = tan(a);
+        if (checked && primal(tanValue) == 0.0) throw "Calculator error: division by 0 (cot = 1 / tan)";
+        return V(1) / tanValue;
+    }
     case TokenType::Tsinh:
-        return "sinh";
+        return sinh(a);
     case TokenType::Tcosh:
-        return "cosh";
+        return cosh(a);
     case TokenType::Tlog:
-        return "log";
-    case TokenType::Tplus:
-        return "plus";
-    case TokenType::Tminus:
-        return "minus";
-    case TokenType::Tmult:
-        return "mult";
-    case TokenType::Tdiv:
-        return "div";
-    case TokenType::Tpow:
-        return "pow";
-    case TokenType::TlParen:
-        return "lParen";
-    case TokenType::TrParen:
-        return "rParen";
-    case TokenType::TEND:
-        return "ENDTOKEN";
+        if (checked && abs(primal(a)) <= 0.0) throw "Calculator error: log argument is outside of log's domain";
+        return log(a); // natural log (base e)
     default:
-        throw "Unknown Token";
+        throw "Calculator error: unknows funcCall TokenType";
     }
 }
 
-char tokenTypeToSymbol(TokenType t) {
-    switch (t) {
-    case TokenType::Tconst:
-        return 'c';
-    case TokenType::Tvariable:
-        return VARIABLE;
+template <typename V>
+V calcBinaryOp(TokenType tokType, V a, V b, bool checked = true) {
+    switch (tokType) {
     case TokenType::Tplus:
-        return '+';
+        return a + b;
     case TokenType::Tminus:
-        return '-';
+        return a - b;
     case TokenType::Tmult:
-        return '*';
+        return a * b;
     case TokenType::Tdiv:
-        return '/';
+        if (checked && primal(b) == 0.0) throw "Calculator error: division by 0";
+        return a / b;
     case TokenType::Tpow:
-        return '^';
-    case TokenType::TlParen:
-        return '(';
-    case TokenType::TrParen:
-        return ')';
+        return pow(a, b);
     default:
-        throw "Unknown Token or token cannot be represented by a symbol (for example funtions or TEND TokenType)";
+        throw "Calculator error: unknows binaryOp TokenType";
     }
 }
 
-string tokenVecToString(const vector<Token>& tokens) {
-    string ret = "";
-    for (const Token& tok : tokens) {
-        ret += tokenTypeToStr(tok.type);
-        if (tok.type == TokenType::Tconst) {
-            ret += " " + double_to_str(tok.value);
-        }
-        ret += "\n";
+class Calculator {
+public:
+    static const size_t MAXRECURSION = 512; // deeper subtrees are walked with an explicit stack
+
+private:
+    vector<value_t> substitutionValues; // indexed by Node::index
+
+    struct Frame {
+        Node* node;
+        int pushedOperands;
+    };
+    vector<Frame> stack;
+    vector<value_t> values; // results of the finished operands
+
+    value_t variable(const Node* node) const {
+        if (node->index >= substitutionValues.size()) throw "Calculator error: wrong number of substitution values";
+        return substitutionValues[node->index];
     }
-    return ret;
-}
 
-string parseTreeToString(const Node* root) {
-    switch (root->type) {
-    case NodeType::variable:
-        return string("") + VARIABLE; // convert char to string
-    case NodeType::constant:
-        return double_to_str(root->value);
-    case NodeType::funcCall:
-        return tokenTypeToStr(root->tokType) + "(" + parseTreeToString(root->a) + ")";
-    case NodeType::binaryOp:
-        return "{" + parseTreeToString(root->a) + tokenTypeToSymbol(root->tokType) + parseTreeToString(root->b) + "}";
-    default:
-        throw "Unknown Node";
+    // leaves are evaluated right away instead of getting a frame
+    void push(Node* node) {
+        switch (node->type) {
+        case NodeType::constant:
+            values.push_back(node->value);
+            break;
+        case NodeType::variable:
+            values.push_back(variable(node));
+            break;
+        default:
+            stack.push_back(Frame{ node, 0 });
+        }
     }
-}
 
-template <typename T>
-class TestSuit {
-private:
-    size_t testNumber;
-public:
-    TestSuit(const string& name, const string& description = "") : testNumber(0) {
-        cout << "Tests about " << name << endl;
-        if (description != "") {
-            cout << "description: " << description << endl;
+    // slower than the recursion, but the depth of the tree is only limited by memory
+    value_t calcIterative(Node* root) {
+        size_t bottom = stack.size();
+        push(root);
+        while (stack.size() > bottom) {
+            Frame& frame = stack.back();
+            Node* node = frame.node;
+            int operandCount = node->type == NodeType::binaryOp ? 2 : 1;
+            if (frame.pushedOperands < operandCount) {
+                ++frame.pushedOperands; // before push(), which can invalidate frame
+                push(frame.pushedOperands == 1 ? node->a : node->b);
+                continue;
+            }
+            stack.pop_back();
+            switch (node->type) {
+            case NodeType::funcCall:
+                values.back() = calcFuncCall(node->tokType, values.back());
+                break;
+            case NodeType::binaryOp:
+            {
+                value_t b = values.back();
+                values.pop_back();
+                values.back() = calcBinaryOp(node->tokType, values.back(), b);
+                break;
+            }
+            default:
+                throw "Calculator error: unknows NodeType";
+            }
         }
+        value_t res = values.back();
+        values.pop_back();
+        return res;
     }
-    void isEq(const T& given, const T& expected, const string& description = "") {
-        cout << "Test (" << description << ") " << testNumber << ": ";
-        if (given == expected) {
-            cout << "correct" << endl;
-        } else {
-            cout << "incorrect:" << endl;
-            cout << "got: " << given << endl;
-            cout << "expected: " << expected << endl;
+
+    value_t calc(Node* root, size_t depth) {
+        if (depth == MAXRECURSION) return calcIterative(root);
+        switch (root->type) {
+        case NodeType::constant:
+            return root->value;
+        case NodeType::variable:
+            return variable(root);
+        case NodeType::funcCall:
+            return calcFuncCall(root->tokType, calc(root->a, depth + 1));
+        case NodeType::binaryOp:
+            return calcBinaryOp(root->tokType, calc(root->a, depth + 1), calc(root->b, depth + 1));
+        default:
+            throw "Calculator error: unknows NodeType";
         }
     }
+
+public:
+    Calculator(value_t substitutionValue) : substitutionValues(1, substitutionValue) {}
+    Calculator(const vector<value_t>& substitutionValues) : substitutionValues(substitutionValues) {}
+    
+    value_t calc(Node* root) {
+        return calc(root, 0);
+    }
 };
 
-int main() {
+// Dual number: value and tangent. Running the tape on duals gives forward-over-reverse second derivatives.
+struct Dual {
+    value_t v;
+    value_t d;
 
-    {
-        /*TestSuit<string> s("Lexer");
+    Dual() : v(0), d(0) {}
+    Dual(value_t v, value_t d = 0) : v(v), d(d) {}
+};
 
-        s.isEq(
-            tokenVecToString(Lexer("421").lex()),
-            "constant 421\nENDOFFILE\n",
-            "integer number");
-        s.isEq(
-            tokenVecToString(Lexer("301.875").lex()),
-            "constant 301.875\nENDOFFILE\n",
-            "rational number");
-        s.isEq(
-            tokenVecToString(Lexer("sin cos + tan cot 10 ^ log x").lex()),
-            "sin\ncos\nplus\ntan\ncot\nconstant 10\npow\nlog\nvariable\nENDOFFILE\n",
-            "functions with variables and contants");
-        s.isEq(
+Dual operator+(const Dual& a, const Dual& b) { return Dual(a.v + b.v, a.d + b.d); }
+Dual operator-(const Dual& a, const Dual& b) { return Dual(a.v - b.v, a.d - b.d); }
+Dual operator-(const Dual& a) { return Dual(-a.v, -a.d); }
+Dual operator*(const Dual& a, const Dual& b) { return Dual(a.v * b.v, a.d * b.v + a.v * b.d); }
+Dual operator/(const Dual& a, const Dual& b) { return Dual(a.v / b.v, (a.d * b.v - a.v * b.d) / (b.v * b.v)); }
+Dual& operator+=(Dual& a, const Dual& b) { a.v += b.v; a.d += b.d; return a; }
+Dual& operator-=(Dual& a, const Dual& b) { a.v -= b.v; a.d -= b.d; return a; }
+
+Dual sin(const Dual& a) { return Dual(sin(a.v), cos(a.v) * a.d); }
+Dual cos(const Dual& a) { return Dual(cos(a.v), -sin(a.v) * a.d); }
+Dual tan(const Dual& a) { value_t c = cos(a.v); return Dual(tan(a.v), a.d / (c * c)); }
+Dual sinh(const Dual& a) { return Dual(sinh(a.v), cosh(a.v) * a.d); }
+Dual cosh(const Dual& a) { return Dual(cosh(a.v), sinh(a.v) * a.d); }
+Dual log(const Dual& a) { return Dual(log(a.v), a.d / a.v); }
+Dual pow(const Dual& a, const Dual& b) {
+    value_t y = pow(a.v, b.v);
+    if (b.d == 0.0) return Dual(y, b.v * pow(a.v, b.v - 1.0) * a.d); // constant exponent, also fine when a.v == 0
+    return Dual(y, y * (b.d * log(a.v) + b.v * a.d / a.v));
+}
+
+// Second-order jet: value, first and second derivative. Evaluating the expression itself on jets gives f'' without
+// building the diff(diff()) tree.
+struct Jet {
+    value_t v;
+    value_t d;
+    value_t dd;
+
+    Jet() : v(0), d(0), dd(0) {}
+    Jet(value_t v, value_t d = 0, value_t dd = 0) : v(v), d(d), dd(dd) {}
+};
+
+// g(a) for a function with g' = gp and g'' = gpp at a.v: (g(a))'' = g''(a) * a'^2 + g'(a) * a''
+Jet chain(const Jet& a, value_t g, value_t gp, value_t gpp) {
+    return Jet(g, gp * a.d, gpp * a.d * a.d + gp * a.dd);
+}
+
+Jet operator+(const Jet& a, const Jet& b) { return Jet(a.v + b.v, a.d + b.d, a.dd + b.dd); }
+Jet operator-(const Jet& a, const Jet& b) { return Jet(a.v - b.v, a.d - b.d, a.dd - b.dd); }
+Jet operator-(const Jet& a) { return Jet(-a.v, -a.d, -a.dd); }
+Jet operator*(const Jet& a, const Jet& b) { return Jet(a.v * b.v, a.d * b.v + a.v * b.d, a.dd * b.v + 2.0 * a.d * b.d + a.v * b.dd); }
+Jet operator/(const Jet& a, const Jet& b) {
+    value_t q = a.v / b.v;
+    value_t qd = (a.d - q * b.d) / b.v;
+    return Jet(q, qd, (a.dd - 2.0 * qd * b.d - q * b.dd) / b.v);
+}
+
+Jet sin(const Jet& a) { value_t s = sin(a.v); return chain(a, s, cos(a.v), -s); }
+Jet cos(const Jet& a) { value_t c = cos(a.v); return chain(a, c, -sin(a.v), -c); }
+Jet tan(const Jet& a) { value_t t = tan(a.v); value_t sec2 = 1.0 + t * t; return chain(a, t, sec2, 2.0 * t * sec2); }
+Jet sinh(const Jet& a) { value_t s = sinh(a.v); value_t c = cosh(a.v); return chain(a, s, c, s); }
+Jet cosh(const Jet& a) { value_t s = sinh(a.v); value_t c = cosh(a.v); return chain(a, c, s, c); }
+Jet log(const Jet& a) { value_t inv = 1.0 / a.v; return chain(a, log(a.v), inv, -inv * inv); }
+Jet exp(const Jet& a) { value_t e = exp(a.v); return chain(a, e, e, e); }
+Jet pow(const Jet& a, const Jet& b) {
+    if (b.d == 0.0 && b.dd == 0.0) { // constant exponent, also fine when a.v == 0
+        value_t y = pow(a.v, b.v);
+        value_t yp = b.v * pow(a.v, b.v - 1.0);
+        return chain(a, y, yp, b.v * (b.v - 1.0) * pow(a.v, b.v - 2.0));
+    }
+    return exp(b * log(a));
+}
+
+value_t primal(const Dual& a) { return a.v; }
+value_t primal(const Jet& a) { return a.v; }
+
+// Flattened expression for reverse-mode automatic differentiation.
+// One forward sweep plus one backward sweep gives the whole gradient, no matter how many variables there are.
+class Tape {
+private:
+    vector<FlatEntry> entries; // topologically ordered
+    vector<size_t> outputs; // tape position of every result, everything a result needs comes before it
+    vector<char> active; // the entry depends on at least one variable, so the reverse sweep has to visit it
+    vector<size_t> variableEntries; // tape position of each variable, npos if it does not occur
+
+    // evaluates the entries up to and including end
+    template <typename T>
+    void forward(const T* at, vector<T>& values, size_t end) const {
+        for (size_t i = 0; i <= end; ++i) {
+            const FlatEntry& e = entries[i];
+            switch (e.type) {
+            case NodeType::constant:
+                values[i] = T(e.value);
+                break;
+            case NodeType::variable:
+                values[i] = at[e.index];
+                break;
+            case NodeType::funcCall:
+                values[i] = calcFuncCall(e.tokType, values[e.a]);
+                break;
+            case NodeType::binaryOp:
+                values[i] = calcBinaryOp(e.tokType, values[e.a], values[e.b]);
+                break;
+            default:
+                throw "Tape error: unknows NodeType";
+            }
+        }
+    }
+
+    // adjoints[i] is d(last result) / d(entry i), accumulated from the result backwards
+    template <typename T>
+    void reverse(const vector<T>& values, vector<T>& adjoints) const {
+        adjoints[outputs.back()] = T(1.0);
+        for (size_t i = outputs.back() + 1; i-- > 0;) {
+            const FlatEntry& e = entries[i];
+            if (!active[i]) continue;
+            const T& ybar = adjoints[i];
+            switch (e.type) {
+            case NodeType::constant:
+            case NodeType::variable:
+                break;
+            case NodeType::funcCall:
+            {
+                const T& x = values[e.a];
+                switch (e.tokType) {
+                case TokenType::Tsin: adjoints[e.a] += ybar * cos(x); break; // (sin(x))' = cos(x)
+                case TokenType::Tcos: adjoints[e.a] -= ybar * sin(x); break; // (cos(x))' = -1 * sin(x)
+                case TokenType::Ttan: { T c = cos(x); adjoints[e.a] += ybar / (c * c); } break; // (tan(x))' = 1 / cos(x)^2
+                case TokenType::Tcot: { T s = sin(x); adjoints[e.a] -= ybar / (s * s); } break; // (cot(x))' = -1 / sin(x)^2
+                case TokenType::Tsinh: adjoints[e.a] += ybar * cosh(x); break; // (sinh(x))' = cosh(x)
+                case TokenType::Tcosh: adjoints[e.a] += ybar * sinh(x); break; // (cosh(x))' = sinh(x)
+                case TokenType::Tlog: adjoints[e.a] += ybar / x; break; // (ln(x))' = 1 / x
+                default:
+                    throw "Tape error: unknows funcCall TokenType";
+                }
+            }
+                break;
+            case NodeType::binaryOp:
+            {
+                const T& a = values[e.a];
+                const T& b = values[e.b];
+                switch (e.tokType) {
+                case TokenType::Tplus:
+                    adjoints[e.a] += ybar;
+                    adjoints[e.b] += ybar;
+                    break;
+                case TokenType::Tminus:
+                    adjoints[e.a] += ybar;
+                    adjoints[e.b] -= ybar;
+                    break;
+                case TokenType::Tmult:
+                    adjoints[e.a] += ybar * b;
+                    adjoints[e.b] += ybar * a;
+                    break;
+                case TokenType::Tdiv:
+                    adjoints[e.a] += ybar / b;
+                    adjoints[e.b] -= ybar * values[i] / b;
+                    break;
+                case TokenType::Tpow: // d(a^b)/da = b * a^(b-1), d(a^b)/db = a^b * ln(a)
+                    if (active[e.a]) adjoints[e.a] += ybar * b * pow(a, b - T(1.0));
+                    if (active[e.b]) adjoints[e.b] += ybar * values[i] * log(a);
+                    break;
+                default:
+                    throw "Tape error: unknows binaryOp TokenType";
+                }
+            }
+                break;
+            default:
+                throw "Tape error: unknows NodeType";
+            }
+        }
+    }
+
+    // forward and reverse sweep, returns the adjoint of every variable
+    template <typename T>
+    vector<T> sweep(const vector<T>& at) const {
+        if (at.size() != variableEntries.size()) throw "Tape error: wrong number of substitution values";
+        vector<T> values(entries.size());
+        vector<T> adjoints(entries.size());
+        forward(at.data(), values, outputs.back());
+        reverse(values, adjoints);
+        vector<T> res(variableEntries.size());
+        for (size_t i = 0; i < variableEntries.size(); ++i) {
+            if (variableEntries[i] != string::npos) res[i] = adjoints[variableEntries[i]];
+        }
+        return res;
+    }
+
+public:
+    Tape(Node* root, size_t variableCount) : Tape(vector<Node*>{ root }, variableCount) {}
+
+    // several results on one tape (like f, f' and f''), subtrees they share are recorded once.
+    // The roots are recorded in order, so evaluating result k only runs the tape up to it.
+    Tape(const vector<Node*>& roots, size_t variableCount) : variableEntries(variableCount) {
+        entries = flatten(roots, variableEntries, outputs);
+        active.resize(entries.size());
+        for (size_t i = 0; i < entries.size(); ++i) {
+            const FlatEntry& e = entries[i];
+            active[i] = e.type == NodeType::variable ||
+                ((e.type == NodeType::funcCall || e.type == NodeType::binaryOp) && active[e.a]) ||
+                (e.type == NodeType::binaryOp && active[e.b]);
+        }
+    }
+
+    size_t size() const {
+        return entries.size();
+    }
+
+    value_t eval(const vector<value_t>& at) const {
+        if (at.size() != variableEntries.size()) throw "Tape error: wrong number of substitution values";
+        vector<value_t> values;
+        return eval(at.data(), values);
+    }
+
+    // in any number type the sweeps support (value_t, Dual, Jet), values is scratch for the intermediate results
+    template <typename T>
+    T eval(const T* at, vector<T>& values, size_t output = 0) const {
+        size_t end = outputs[output];
+        if (values.size() <= end) values.resize(end + 1);
+        forward(at, values, end);
+        return values[end];
+    }
+
+    // all first partial derivatives of the last result in one backward sweep
+    vector<value_t> gradient(const vector<value_t>& at) const {
+        return sweep(at);
+    }
+
+    // forward-over-reverse: one dual sweep per variable, each gives a column of the Hessian
+    vector<vector<value_t>> hessian(const vector<value_t>& at) const {
+        if (at.size() != variableEntries.size()) throw "Tape error: wrong number of substitution values";
+        size_t n = variableEntries.size();
+        vector<vector<value_t>> res(n, vector<value_t>(n));
+        vector<Dual> seeded(n);
+        for (size_t i = 0; i < n; ++i) {
+            seeded[i] = Dual(at[i]);
+        }
+        for (size_t j = 0; j < n; ++j) {
+            seeded[j].d = 1;
+            vector<Dual> column = sweep(seeded);
+            seeded[j].d = 0;
+            for (size_t i = 0; i < n; ++i) {
+                res[i][j] = column[i].d;
+            }
+        }
+        return res;
+    }
+};
+
+Tape makeTape(const string& eq, const vector<string>& variables) {
+    Lexer myLexer(eq, variables);
+    Parser myParser(myLexer.lex());
+    return Tape(myParser.parse(), variables.size());
+}
+
+// Expression with named, mutable parameters, evaluated over a cached batch of points.
+// Every subexpression keeps its results for the whole batch. Changing a parameter only marks the subexpressions that
+// depend on it dirty, so the next eval() recomputes those and reuses everything else.
+class CompiledExpression {
+private:
+    vector<FlatEntry> entries; // topologically ordered, the last entry is the result. Variables come first in the name
+                               // list, then parameters
+    vector<char> varying; // the entry depends on the evaluation point, so it holds one result per point instead of a single one
+    vector<vector<value_t>> columns; // cached results of every entry
+    vector<char> dirty;
+    vector<vector<size_t>> dependents; // entries depending on each parameter
+    vector<size_t> nameEntries; // tape position of every variable and parameter, npos if it does not occur
+
+    size_t variableCount;
+    vector<string> parameterNames;
+    vector<value_t> parameterValues;
+    size_t pointCount = 0;
+    vector<value_t> results; // only used when the result does not depend on the points
+    size_t recomputed = 0;
+
+    void markDirty(const vector<size_t>& toMark) {
+        for (size_t i : toMark) {
+            dirty[i] = 1;
+        }
+    }
+
+    void recompute(size_t i) {
+        const FlatEntry& e = entries[i];
+        vector<value_t>& res = columns[i];
+        switch (e.type) {
+        case NodeType::constant:
+            res.assign(1, e.value);
+            break;
+        case NodeType::variable:
+            if (e.index >= variableCount) res.assign(1, parameterValues[e.index - variableCount]);
+            // evaluation points are written straight into their column by setPoints()
+            break;
+        case NodeType::funcCall:
+        {
+            const vector<value_t>& a = columns[e.a];
+            res.resize(a.size());
+            for (size_t k = 0; k < a.size(); ++k) {
+                res[k] = calcFuncCall(e.tokType, a[k]);
+            }
+        }
+            break;
+        case NodeType::binaryOp:
+        {
+            // a column of size 1 is broadcast to every point
+            const vector<value_t>& a = columns[e.a];
+            const vector<value_t>& b = columns[e.b];
+            size_t n = varying[i] ? pointCount : 1;
+            size_t aStep = a.size() == 1 ? 0 : 1;
+            size_t bStep = b.size() == 1 ? 0 : 1;
+            res.resize(n);
+            for (size_t k = 0; k < n; ++k) {
+                res[k] = calcBinaryOp(e.tokType, a[k * aStep], b[k * bStep]);
+            }
+        }
+            break;
+        default:
+            throw "CompiledExpression error: unknows NodeType";
+        }
+    }
+
+public:
+    // derivativeOrder > 0 compiles that derivative with respect to the first variable instead of the expression itself
+    CompiledExpression(const string& eq, const vector<string>& variables, const vector<string>& parameters, size_t derivativeOrder = 0)
+        : variableCount(variables.size()), parameterNames(parameters), parameterValues(parameters.size(), 0) {
+        vector<string> names = variables;
+        names.insert(names.end(), parameters.begin(), parameters.end());
+        nameEntries.resize(names.size());
+
+        Lexer myLexer(eq, names);
+        Parser myParser(myLexer.lex());
+        Node* tree = myParser.parse();
+        for (size_t i = 0; i < derivativeOrder; ++i) {
+            tree = diff(tree, 0);
+        }
+        vector<size_t> outputs;
+        entries = flatten({ tree }, nameEntries, outputs);
+        varying.resize(entries.size());
+        for (size_t i = 0; i < entries.size(); ++i) {
+            const FlatEntry& e = entries[i];
+            varying[i] = (e.type == NodeType::variable && e.index < variableCount) ||
+                ((e.type == NodeType::funcCall || e.type == NodeType::binaryOp) && varying[e.a]) ||
+                (e.type == NodeType::binaryOp && varying[e.b]);
+        }
+
+        columns.resize(entries.size());
+        dirty.assign(entries.size(), 1);
+        dependents.resize(parameters.size());
+        vector<char> depends(entries.size());
+        for (size_t p = 0; p < parameters.size(); ++p) {
+            for (size_t i = 0; i < entries.size(); ++i) {
+                const FlatEntry& e = entries[i];
+                depends[i] = (e.type == NodeType::variable && e.index == variableCount + p) ||
+                    ((e.type == NodeType::funcCall || e.type == NodeType::binaryOp) && depends[e.a]) ||
+                    (e.type == NodeType::binaryOp && depends[e.b]);
+                if (depends[i]) dependents[p].push_back(i);
+            }
+        }
+    }
+
+    size_t parameterIndex(const string& name) const {
+        size_t i = find(parameterNames.begin(), parameterNames.end(), name) - parameterNames.begin();
+        if (i == parameterNames.size()) throw "CompiledExpression error: unknown parameter";
+        return i;
+    }
+
+    value_t parameter(const string& name) const {
+        return parameterValues[parameterIndex(name)];
+    }
+
+    void setParameter(size_t index, value_t value) {
+        if (parameterValues[index] == value) return;
+        parameterValues[index] = value;
+        markDirty(dependents[index]);
+    }
+
+    void setParameter(const string& name, value_t value) {
+        setParameter(parameterIndex(name), value);
+    }
+
+    // points[k] holds one value per variable
+    void setPoints(const vector<vector<value_t>>& points) {
+        pointCount = points.size();
+        for (size_t v = 0; v < variableCount; ++v) {
+            if (nameEntries[v] == string::npos) continue;
+            vector<value_t>& column = columns[nameEntries[v]];
+            column.resize(pointCount);
+            for (size_t k = 0; k < pointCount; ++k) {
+                column[k] = points[k][v];
+            }
+        }
+        for (size_t i = 0; i < entries.size(); ++i) {
+            if (varying[i]) dirty[i] = 1;
+        }
+    }
+
+    // shortcut for expressions of a single variable
+    void setPoints(const vector<value_t>& points) {
+        vector<vector<value_t>> wrapped;
+        wrapped.reserve(points.size());
+        for (const value_t& point : points) {
+            wrapped.push_back({ point });
+        }
+        setPoints(wrapped);
+    }
+
+    // results for the cached points, only dirty subexpressions are recomputed
+    const vector<value_t>& eval() {
+        recomputed = 0;
+        for (size_t i = 0; i < entries.size(); ++i) {
+            if (!dirty[i]) continue;
+            recompute(i);
+            dirty[i] = 0;
+            ++recomputed;
+        }
+        const vector<value_t>& root = columns.back();
+        if (root.size() == pointCount) return root;
+        results.assign(pointCount, root.empty() ? value_t(0) : root[0]); // the result does not depend on the points
+        return results;
+    }
+
+    size_t size() const {
+        return entries.size();
+    }
+
+    // number of subexpressions the last eval() had to recompute
+    size_t lastRecomputed() const {
+        return recomputed;
+    }
+};
+
+// Several single-variable expressions flattened into one program, so subexpressions they share (f, f' and f'' share a lot)
+// are evaluated once. Evaluation is column by column over a batch of lanes and unchecked.
+// V is the complex type the program computes in: complex<float> doubles the lanes per SIMD register.
+template <typename V>
+class BasicFusedProgram {
+private:
+    using real_t = typename V::value_type;
+
+    vector<FlatEntry> code;
+    vector<size_t> outputs; // position of every root in the code
+
+    static real_t size(V v) {
+        return abs(v.real()) + abs(v.imag());
+    }
+
+    // magnitude[k] = max(magnitude[k], size(v[k]))
+    static void track(real_t* magnitude, const V* v, size_t n) {
+        if (magnitude == nullptr) return;
+        for (size_t k = 0; k < n; ++k) magnitude[k] = max(magnitude[k], size(v[k]));
+    }
+
+public:
+    static const size_t LANES = 64; // lanes evaluated together, scratch has to hold size() * LANES values
+
+    BasicFusedProgram(const vector<Node*>& roots) {
+        vector<size_t> variableAt(1);
+        code = flatten(roots, variableAt, outputs);
+        if (variableAt.size() != 1) throw "FusedProgram error: only single-variable expressions are supported";
+    }
+
+    size_t size() const {
+        return code.size();
+    }
+
+    size_t outputCount() const {
+        return outputs.size();
+    }
+
+    // evaluates n <= LANES lanes, out[r][k] is the value of roots[r] at x[k].
+    // If magnitude is given, magnitude[k] gets the largest |re| + |im| of lane k among the operands of + and - (|a| + |b|,
+    // the scale of the rounding error when they cancel) and the arguments of the functions and pow (where a rounded
+    // argument gets amplified). Multiplication and division are left out: they keep relative errors small.
+    void eval(const V* x, size_t n, vector<V>& scratch, V* const* out, real_t* magnitude = nullptr) const {
+        scratch.resize(code.size() * LANES);
+        if (magnitude != nullptr) fill(magnitude, magnitude + n, real_t(0));
+        for (size_t i = 0; i < code.size(); ++i) {
+            const FlatEntry& in = code[i];
+            V* res = &scratch[i * LANES];
+            const V* a = &scratch[in.a * LANES];
+            const V* b = &scratch[in.b * LANES];
+            switch (in.type) {
+            case NodeType::constant:
+            {
+                V value(static_cast<real_t>(in.value));
+                for (size_t k = 0; k < n; ++k) res[k] = value;
+            }
+                break;
+            case NodeType::variable:
+                for (size_t k = 0; k < n; ++k) res[k] = x[k];
+                break;
+            case NodeType::funcCall: // in double, the library's complex<float> functions are slower than the complex<double> ones
+                for (size_t k = 0; k < n; ++k) res[k] = V(calcFuncCall(in.tokType, value_t(a[k]), false));
+                track(magnitude, a, n);
+                break;
+            case NodeType::binaryOp:
+                switch (in.tokType) { // the cheap operations get their own loops, so the compiler can vectorize them
+                case TokenType::Tplus:
+                    if (magnitude == nullptr) {
+                        for (size_t k = 0; k < n; ++k) res[k] = a[k] + b[k];
+                    } else {
+                        for (size_t k = 0; k < n; ++k) {
+                            res[k] = a[k] + b[k];
+                            magnitude[k] = max(magnitude[k], size(a[k]) + size(b[k]));
+                        }
+                    }
+                    break;
+                case TokenType::Tminus:
+                    if (magnitude == nullptr) {
+                        for (size_t k = 0; k < n; ++k) res[k] = a[k] - b[k];
+                    } else {
+                        for (size_t k = 0; k < n; ++k) {
+                            res[k] = a[k] - b[k];
+                            magnitude[k] = max(magnitude[k], size(a[k]) + size(b[k]));
+                        }
+                    }
+                    break;
+                case TokenType::Tmult: // written out: operator* goes through a library call that handles inf * 0 per the C standard
+                    for (size_t k = 0; k < n; ++k) {
+                        res[k] = V(a[k].real() * b[k].real() - a[k].imag() * b[k].imag(), a[k].real() * b[k].imag() + a[k].imag() * b[k].real());
+                    }
+                    break;
+                default: // division and pow in double too, like the functions
+                    for (size_t k = 0; k < n; ++k) res[k] = V(calcBinaryOp(in.tokType, value_t(a[k]), value_t(b[k]), false));
+                    if (in.tokType == TokenType::Tpow) {
+                        track(magnitude, a, n);
+                        track(magnitude, b, n);
+                    }
+                }
+                break;
+            default:
+                throw "FusedProgram error: unknows NodeType";
+            }
+        }
+        for (size_t r = 0; r < outputs.size(); ++r) {
+            copy(scratch.begin() + outputs[r] * LANES, scratch.begin() + outputs[r] * LANES + n, out[r]);
+        }
+    }
+
+    // evaluates any number of points, res[r][k] is the value of roots[r] at x[k]
+    vector<vector<V>> evalAll(const vector<V>& x) const {
+        vector<vector<V>> res(outputs.size(), vector<V>(x.size()));
+        vector<V> scratch;
+        vector<V*> out(outputs.size());
+        for (size_t start = 0; start < x.size(); start += LANES) {
+            for (size_t r = 0; r < outputs.size(); ++r) {
+                out[r] = &res[r][start];
+            }
+            eval(&x[start], min(x.size() - start, size_t(LANES)), scratch, out.data());
+        }
+        return res;
+    }
+};
+
+using FusedProgram = BasicFusedProgram<value_t>;
+
+enum RootMethod {
+    newton, // x -= f / f'
+    halley // x -= 2 f f' / (2 f'^2 - f f''), cubic convergence for the price of f''
+};
+
+struct RootResult {
+    value_t root; // last iterate if it did not converge
+    size_t iterations;
+    bool converged;
+};
+
+template <typename V>
+bool isFinite(V a) {
+    return isfinite(a.real()) && isfinite(a.imag());
+}
+
+// Runs Newton or Halley iterations from every starting point. Starting points are processed in blocks of FusedProgram::LANES
+// spread over threadCount threads (0: one per core), converged or diverged lanes are dropped from their block right away.
+vector<RootResult> findRoots(const string& eq, const vector<value_t>& starts, RootMethod method = RootMethod::newton,
+    size_t maxIterations = 100, double tolerance = 1e-12, unsigned threadCount = 0) {
+
+    Lexer myLexer(eq);
+    Parser myParser(myLexer.lex());
+    Node* eqTree = myParser.parse();
+    Node* firstDiffTree = diff(eqTree);
+    vector<Node*> roots = { eqTree, firstDiffTree };
+    if (method == RootMethod::halley) roots.push_back(diff(firstDiffTree));
+    const FusedProgram program(roots);
+
+    vector<RootResult> res(starts.size());
+    const size_t LANES = FusedProgram::LANES;
+    const size_t blockCount = (starts.size() + LANES - 1) / LANES;
+    atomic<size_t> nextBlock(0);
+
+    auto worker = [&]() {
+        vector<value_t> scratch;
+        value_t x[LANES], f[LANES], fp[LANES], fpp[LANES];
+        value_t* out[3] = { f, fp, fpp };
+        size_t lane[LANES]; // which starting point is in each active lane
+
+        for (size_t block = nextBlock++; block < blockCount; block = nextBlock++) {
+            size_t n = 0;
+            for (size_t i = block * LANES; i < starts.size() && i < (block + 1) * LANES; ++i) {
+                x[n] = starts[i];
+                lane[n] = i;
+                res[i] = RootResult{ starts[i], 0, false };
+                ++n;
+            }
+            for (size_t iteration = 0; iteration < maxIterations && n > 0; ++iteration) {
+                program.eval(x, n, scratch, out);
+                size_t kept = 0;
+                for (size_t k = 0; k < n; ++k) {
+                    RootResult& r = res[lane[k]];
+                    value_t step = 0;
+                    bool done = false;
+                    if (f[k] == 0.0) {
+                        r.converged = done = true;
+                    } else {
+                        step = method == RootMethod::halley
+                            ? 2.0 * f[k] * fp[k] / (2.0 * fp[k] * fp[k] - f[k] * fpp[k])
+                            : f[k] / fp[k];
+                        if (!isFinite(step)) {
+                            done = true; // pole or flat spot, the lane is dropped as not converged
+                        } else {
+                            x[k] -= step;
+                            ++r.iterations;
+                            r.converged = done = abs(step) <= tolerance * max(1.0, abs(x[k]));
+                        }
+                    }
+                    r.root = x[k];
+                    if (!done) { // compaction keeps the active lanes at the front
+                        x[kept] = x[k];
+                        lane[kept] = lane[k];
+                        ++kept;
+                    }
+                }
+                n = kept;
+            }
+        }
+    };
+
+    if (threadCount == 0) threadCount = max(1u, thread::hardware_concurrency());
+    vector<thread> threads;
+    for (unsigned t = 1; t < threadCount; ++t) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (thread& t : threads) {
+        t.join();
+    }
+    return res;
+}
+
+// Single-variable tape for several results, flattened on the first call that needs it. Every thread reuses its own
+// scratch space for the intermediate results.
+class LazyTape {
+private:
+    vector<Node*> roots;
+    mutable once_flag flattened;
+    mutable unique_ptr<const Tape> tape;
+
+public:
+    LazyTape(const vector<Node*>& roots) : roots(roots) {}
+
+    value_t eval(value_t x, size_t output) const {
+        call_once(flattened, [this]() { tape.reset(new Tape(roots, 1)); });
+        static thread_local vector<value_t> scratch;
+        return tape->eval(&x, scratch, output);
+    }
+};
+
+tuple<func_t, func_t, func_t> differentiate(const string& eq) {
+
+    Lexer myLexer(eq);
+    vector<Token> myTokens = myLexer.lex();
+
+    Parser myParser(myTokens);
+    Node* eqTree = myParser.parse(); // build abstract syntax tree
+
+    Node* firstDiffTree = diff(eqTree);
+
+    Node* secondDiffTree = diff(firstDiffTree);
+
+    // The parser shares no nodes, so walking f costs what its tape would, minus flattening it. The derivative trees share
+    // a lot of subtrees, which a tree walk would evaluate once for every path to them: they are evaluated on one tape, so
+    // what f' and f'' share is flattened once, and only when one of them is called.
+    shared_ptr<const LazyTape> derivatives = make_shared<const LazyTape>(vector<Node*>{ firstDiffTree, secondDiffTree });
+    return {
+        [eqTree](value_t substitutionValue) {
+            Calculator myCalculator(substitutionValue);
+            return myCalculator.calc(eqTree);
+        },
+        [derivatives](value_t substitutionValue) {
+            return derivatives->eval(substitutionValue, 0);
+        },
+        [derivatives](value_t substitutionValue) {
+            return derivatives->eval(substitutionValue, 1);
+        }
+    };
+}
+
+// f, f' and f'' of eq, differentiated after lowerPowers()
+vector<Node*> loweredDiffTrees(const string& eq) {
+    Lexer myLexer(eq);
+    Parser myParser(myLexer.lex());
+    Node* eqTree = lowerPowers(myParser.parse());
+    Node* firstDiffTree = diff(eqTree);
+    return { eqTree, firstDiffTree, diff(firstDiffTree) };
+}
+
+// Evaluates in complex<float> and re-evaluates in double only the points whose error estimate exceeds the threshold.
+// The estimate is float epsilon * the largest magnitude the point reaches where float loses its digits (see
+// BasicFusedProgram::eval()), relative to the result (absolute below magnitude 1, like the surrogate's tolerance).
+// Non-finite results are re-evaluated too. Functions, division and pow are computed in double by both engines, so programs
+// using them gain nothing from float and are evaluated in double right away. Small integer powers are lowered to
+// multiplications first (lowerPowers()); built from the expression string that happens before diff(), so polynomials
+// written with ^ are evaluated in float including their derivatives.
+class MixedPrecisionProgram {
+private:
+    using single_t = complex<float>;
+
+    BasicFusedProgram<single_t> single;
+    FusedProgram full;
+    double threshold;
+    bool useSingle;
+
+    static bool onlyArithmetic(const vector<Node*>& roots) {
+        for (Node* node : postOrder(roots)) {
+            if (node->type == NodeType::funcCall || node->tokType == TokenType::Tdiv || node->tokType == TokenType::Tpow) return false;
+        }
+        return true;
+    }
+
+    static vector<Node*> lowered(vector<Node*> roots) {
+        for (Node*& root : roots) {
+            root = lowerPowers(root);
+        }
+        return roots;
+    }
+
+    MixedPrecisionProgram(const vector<Node*>& lowered, double threshold, bool /* already lowered */)
+        : single(lowered), full(lowered), threshold(threshold), useSingle(onlyArithmetic(lowered)) {}
+
+public:
+    MixedPrecisionProgram(const vector<Node*>& roots, double threshold) : MixedPrecisionProgram(lowered(roots), threshold, true) {}
+
+    // f, f' and f''
+    MixedPrecisionProgram(const string& eq, double threshold) : MixedPrecisionProgram(loweredDiffTrees(eq), threshold, true) {}
+
+    // false if every point is evaluated in double
+    bool inSingle() const {
+        return useSingle;
+    }
+
+    // res[r][k] is the value of roots[r] at x[k], returns how many points had to be re-evaluated in double
+    size_t evalAll(const vector<value_t>& x, vector<vector<value_t>>& res) const {
+        if (!useSingle) {
+            res = full.evalAll(x);
+            return 0;
+        }
+        const size_t LANES = FusedProgram::LANES;
+        const size_t outputCount = full.outputCount();
+        const float epsilon = numeric_limits<float>::epsilon();
+        res.assign(outputCount, vector<value_t>(x.size()));
+
+        vector<single_t> singleScratch;
+        vector<value_t> fullScratch;
+        vector<vector<single_t>> singleOut(outputCount, vector<single_t>(LANES));
+        vector<vector<value_t>> fullOut(outputCount, vector<value_t>(LANES));
+        vector<single_t*> singleOutPtr;
+        vector<value_t*> fullOutPtr;
+        for (size_t r = 0; r < outputCount; ++r) {
+            singleOutPtr.push_back(singleOut[r].data());
+            fullOutPtr.push_back(fullOut[r].data());
+        }
+        single_t xs[LANES];
+        float magnitude[LANES];
+        value_t flagged[LANES];
+        size_t flaggedAt[LANES];
+
+        size_t reevaluated = 0;
+        for (size_t start = 0; start < x.size(); start += LANES) {
+            size_t n = min(x.size() - start, LANES);
+            for (size_t k = 0; k < n; ++k) {
+                xs[k] = single_t(x[start + k]);
+            }
+            single.eval(xs, n, singleScratch, singleOutPtr.data(), magnitude);
+
+            size_t m = 0;
+            for (size_t k = 0; k < n; ++k) {
+                bool accurate = true;
+                for (size_t r = 0; r < outputCount; ++r) {
+                    single_t v = singleOut[r][k];
+                    res[r][start + k] = value_t(v);
+                    accurate = accurate && isFinite(v) && epsilon * magnitude[k] <= threshold * max(1.0f, abs(v.real()) + abs(v.imag()));
+                }
+                if (!accurate) {
+                    flagged[m] = x[start + k];
+                    flaggedAt[m] = start + k;
+                    ++m;
+                }
+            }
+            if (m == 0) continue;
+            full.eval(flagged, m, fullScratch, fullOutPtr.data());
+            for (size_t j = 0; j < m; ++j) {
+                for (size_t r = 0; r < outputCount; ++r) {
+                    res[r][flaggedAt[j]] = fullOut[r][j];
+                }
+            }
+            reevaluated += m;
+        }
+        return reevaluated;
+    }
+};
+
+enum RegionShape {
+    rectangle,
+    disk
+};
+
+// Part of the complex plane the surrogate covers
+struct SurrogateRegion {
+    RegionShape shape;
+    value_t center;
+    value_t halfSize; // half width (real part) and half height (imaginary part), a disk uses the real part as radius
+
+    bool contains(value_t x) const {
+        value_t d = x - center;
+        if (shape == RegionShape::disk) return abs(d) <= halfSize.real();
+        return abs(d.real()) <= halfSize.real() && abs(d.imag()) <= halfSize.imag();
+    }
+
+    value_t boundingHalfSize() const {
+        return shape == RegionShape::disk ? value_t(halfSize.real(), halfSize.real()) : halfSize;
+    }
+};
+
+// Piecewise polynomial approximation of f, f' and f'' over a fixed region.
+// The region is split into a quadtree. Each cell gets a Taylor polynomial from samples on the circle through its corners
+// (discrete Cauchy integral), which is checked against the exact evaluator inside the cell; cells that miss the
+// tolerance are subdivided. Cells that still miss it at maxDepth (poles, branch cuts of log) and points outside the
+// region are evaluated exactly.
+// The tolerance is a target, not a bound: the check only sees its sample points. It asks for FITMARGIN * tolerance there,
+// since the error between the samples can be larger (up to 1.1x the tolerance without the margin, well inside it with).
+class Surrogate {
+private:
+    static const size_t SAMPLES = 16; // polynomial degree + 1
+    static const size_t CHECKS = 4; // the fit is checked on a CHECKS x CHECKS grid of interior points and the corners
+    static constexpr double FITMARGIN = 0.5;
+
+    struct Cell {
+        value_t center;
+        value_t halfSize;
+        double radius; // sampling circle, the polynomials are in (x - center) / radius
+        size_t children; // index of the first of the 4 children, 0 for leaves (the root is never a child)
+        bool exact;
+        size_t coefficients; // offset of 3 * SAMPLES coefficients: f, f', f''
+    };
+
+    SurrogateRegion region;
+    double tolerance;
+    size_t maxDepth;
+    Tape exact; // f, f' and f'' (its results 0, 1 and 2) where the polynomials do not apply
+    FusedProgram program;
+    vector<Cell> cells;
+    vector<value_t> coefficients;
+    vector<value_t> scratch;
+    size_t oracleCalls = 0;
+    size_t exactCells = 0;
+
+    static value_t horner(const value_t* a, value_t w) {
+        value_t res = a[SAMPLES - 1];
+        for (size_t k = SAMPLES - 1; k-- > 0;) {
+            res = res * w + a[k];
+        }
+        return res;
+    }
+
+    bool outsideRegion(const Cell& cell) const {
+        if (region.shape != RegionShape::disk) return false;
+        value_t d = region.center - cell.center;
+        double dx = max(0.0, abs(d.real()) - cell.halfSize.real());
+        double dy = max(0.0, abs(d.imag()) - cell.halfSize.imag());
+        return dx * dx + dy * dy > region.halfSize.real() * region.halfSize.real();
+    }
+
+    bool fit(size_t cellIndex) {
+        const Cell& cell = cells[cellIndex];
+        const double PI = 3.14159265358979323846;
+        value_t x[FusedProgram::LANES], f[3][FusedProgram::LANES];
+        value_t* out[3] = { f[0], f[1], f[2] };
+
+        value_t unit[SAMPLES];
+        for (size_t j = 0; j < SAMPLES; ++j) {
+            unit[j] = polar(1.0, 2 * PI * j / SAMPLES);
+            x[j] = cell.center + cell.radius * unit[j];
+        }
+        program.eval(x, SAMPLES, scratch, out);
+        oracleCalls += SAMPLES;
+
+        vector<value_t> a(3 * SAMPLES);
+        for (size_t order = 0; order < 3; ++order) {
+            for (size_t j = 0; j < SAMPLES; ++j) {
+                if (!isFinite(f[order][j])) return false;
+            }
+            for (size_t k = 0; k < SAMPLES; ++k) {
+                value_t sum = 0;
+                for (size_t j = 0; j < SAMPLES; ++j) {
+                    sum += f[order][j] * conj(unit[(j * k) % SAMPLES]);
+                }
+                a[order * SAMPLES + k] = sum / (double)SAMPLES;
+            }
+        }
+
+        size_t n = 0;
+        for (size_t i = 0; i < CHECKS; ++i) {
+            for (size_t j = 0; j < CHECKS; ++j) {
+                x[n++] = cell.center + value_t(cell.halfSize.real() * ((2 * i + 1.0) / CHECKS - 1), cell.halfSize.imag() * ((2 * j + 1.0) / CHECKS - 1));
+            }
+        }
+        for (double sx : { -1.0, 1.0 }) {
+            for (double sy : { -1.0, 1.0 }) {
+                x[n++] = cell.center + value_t(sx * cell.halfSize.real(), sy * cell.halfSize.imag());
+            }
+        }
+        program.eval(x, n, scratch, out);
+        oracleCalls += n;
+        for (size_t order = 0; order < 3; ++order) {
+            for (size_t k = 0; k < n; ++k) {
+                value_t approx = horner(&a[order * SAMPLES], (x[k] - cell.center) / cell.radius);
+                if (!isFinite(f[order][k]) || abs(approx - f[order][k]) > FITMARGIN * tolerance * max(1.0, abs(f[order][k]))) return false;
+            }
+        }
+
+        cells[cellIndex].coefficients = coefficients.size();
+        coefficients.insert(coefficients.end(), a.begin(), a.end());
+        return true;
+    }
+
+    void build(size_t cellIndex, size_t depth) {
+        if (outsideRegion(cells[cellIndex])) {
+            cells[cellIndex].exact = true; // never looked up, region.contains() is false everywhere in it
+            return;
+        }
+        if (fit(cellIndex)) return;
+        if (depth == maxDepth) {
+            cells[cellIndex].exact = true;
+            ++exactCells;
+            return;
+        }
+        value_t center = cells[cellIndex].center;
+        value_t half = cells[cellIndex].halfSize / 2.0;
+        size_t first = cells.size();
+        cells[cellIndex].children = first;
+        for (size_t q = 0; q < 4; ++q) { // quadrant q: bit 0 is the right half, bit 1 is the upper half
+            value_t childCenter = center + value_t(q & 1 ? half.real() : -half.real(), q & 2 ? half.imag() : -half.imag());
+            cells.push_back(Cell{ childCenter, half, abs(half), 0, false, 0 });
+        }
+        for (size_t q = 0; q < 4; ++q) {
+            build(first + q, depth + 1);
+        }
+    }
+
+    const Cell& leaf(value_t x) const {
+        const Cell* cell = &cells[0];
+        while (cell->children != 0) {
+            size_t q = (x.real() >= cell->center.real() ? 1 : 0) + (x.imag() >= cell->center.imag() ? 2 : 0);
+            cell = &cells[cell->children + q];
+        }
+        return *cell;
+    }
+
+    static vector<Node*> diffTrees(const string& eq) {
+        Lexer myLexer(eq);
+        Parser myParser(myLexer.lex());
+        Node* eqTree = myParser.parse();
+        Node* firstDiffTree = diff(eqTree);
+        return { eqTree, firstDiffTree, diff(firstDiffTree) };
+    }
+
+    Surrogate(const vector<Node*>& roots, const SurrogateRegion& region, double tolerance, size_t maxDepth)
+        : region(region), tolerance(tolerance), maxDepth(maxDepth), exact(roots, 1), program(roots) {
+        value_t half = region.boundingHalfSize();
+        cells.push_back(Cell{ region.center, half, abs(half), 0, false, 0 });
+        build(0, 0);
+    }
+
+public:
+    // tolerance is relative to the magnitude of the value (absolute below magnitude 1)
+    Surrogate(const string& eq, const SurrogateRegion& region, double tolerance, size_t maxDepth = 10)
+        : Surrogate(diffTrees(eq), region, tolerance, maxDepth) {}
+
+    // order 0 is f, 1 is f', 2 is f''
+    value_t eval(value_t x, size_t order = 0) const {
+        if (region.contains(x)) {
+            const Cell& cell = leaf(x);
+            if (!cell.exact) return horner(&coefficients[cell.coefficients + order * SAMPLES], (x - cell.center) / cell.radius);
+        }
+        static thread_local vector<value_t> scratch;
+        return exact.eval(&x, scratch, order);
+    }
+
+    size_t cellCount() const {
+        return cells.size();
+    }
+
+    size_t exactCellCount() const {
+        return exactCells;
+    }
+
+    size_t oracleCallCount() const {
+        return oracleCalls;
+    }
+};
+
+// Like differentiate(), but evaluations inside the region go through a surrogate built to the given tolerance
+tuple<func_t, func_t, func_t> differentiate(const string& eq, const SurrogateRegion& region, double tolerance) {
+    shared_ptr<const Surrogate> surrogate = make_shared<const Surrogate>(eq, region, tolerance);
+    return {
+        [surrogate](value_t substitutionValue) {
+            return surrogate->eval(substitutionValue, 0);
+        },
+        [surrogate](value_t substitutionValue) {
+            return surrogate->eval(substitutionValue, 1);
+        },
+        [surrogate](value_t substitutionValue) {
+            return surrogate->eval(substitutionValue, 2);
+        }
+    };
+}
+
+// For testing
+
+string double_to_str(double d) {
+    if (floor(d) == d) {
+        return to_string((int)d);
+    }
+    string res = to_string(d);
+    while (res.back() == '0') {
+        res.pop_back();
+    }
+    return res;
+}
+
+string tokenTypeToStr(TokenType t) {
+    switch (t) {
+    case TokenType::Tconst:
+        return "constant";
+    case TokenType::Tvariable:
+        return "variable";
+    case TokenType::Tsin:
+        return "sin";
+    case TokenType::Tcos:
+        return "cos";
+    case TokenType::Ttan:
+        return "tan";
+    case TokenType::Tcot:
+        return "cot";
+    case TokenType::Tsinh:
+        return "sinh";
+    case TokenType::Tcosh:
+        return "cosh";
+    case TokenType::Tlog:
+        return "log";
+    case TokenType::Tplus:
+        return "plus";
+    case TokenType::Tminus:
+        return "minus";
+    case TokenType::Tmult:
+        return "mult";
+    case TokenType::Tdiv:
+        return "div";
+    case TokenType::Tpow:
+        return "pow";
+    case TokenType::TlParen:
+        return "lParen";
+    case TokenType::TrParen:
+        return "rParen";
+    case TokenType::TEND:
+        return "ENDTOKEN";
+    default:
+        throw "Unknown Token";
+    }
+}
+
+char tokenTypeToSymbol(TokenType t) {
+    switch (t) {
+    case TokenType::Tconst:
+        return 'c';
+    case TokenType::Tvariable:
+        return VARIABLE;
+    case TokenType::Tplus:
+        return '+';
+    case TokenType::Tminus:
+        return '-';
+    case TokenType::Tmult:
+        return '*';
+    case TokenType::Tdiv:
+        return '/';
+    case TokenType::Tpow:
+        return '^';
+    case TokenType::TlParen:
+        return '(';
+    case TokenType::TrParen:
+        return ')';
+    default:
+        throw "Unknown Token or token cannot be represented by a symbol (for example funtions or TEND TokenType)";
+    }
+}
+
+string tokenVecToString(const vector<Token>& tokens) {
+    string ret = "";
+    for (const Token& tok : tokens) {
+        ret += tokenTypeToStr(tok.type);
+        if (tok.type == TokenType::Tconst) {
+            ret += " " + double_to_str(tok.value);
+        }
+        ret += "\n";
+    }
+    return ret;
+}
+
+string parseTreeToString(const Node* root, const vector<string>& variables = DEFAULTVARIABLES) {
+    switch (root->type) {
+    case NodeType::variable:
+        return variables[root->index];
+    case NodeType::constant:
+        return double_to_str(root->value);
+    case NodeType::funcCall:
+        return tokenTypeToStr(root->tokType) + "(" + parseTreeToString(root->a, variables) + ")";
+    case NodeType::binaryOp:
+        return "{" + parseTreeToString(root->a, variables) + tokenTypeToSymbol(root->tokType) + parseTreeToString(root->b, variables) + "}";
+    default:
+        throw "Unknown Node";
+    }
+}
+
+template <typename T>
+class TestSuit {
+private:
+    size_t testNumber;
+public:
+    TestSuit(const string& name, const string& description = "") : testNumber(0) {
+        cout << "Tests about " << name << endl;
+        if (description != "") {
+            cout << "description: " << description << endl;
+        }
+    }
+    void isEq(const T& given, const T& expected, const string& description = "") {
+        cout << "Test (" << description << ") " << testNumber << ": ";
+        if (given == expected) {
+            cout << "correct" << endl;
+        } else {
+            cout << "incorrect:" << endl;
+            cout << "got: " << given << endl;
+            cout << "expected: " << expected << endl;
+        }
+    }
+};
+
+enum EvalStrategy {
+    flatTape, // the tree diff() produced, flattened into a Tape: shared subtrees are evaluated once
+    jetTape // the expression itself on a Tape in Dual (f') or Jet (f'') numbers, no diff() tree at all
+};
+
+const size_t STRATEGYCOUNT = 2;
+
+string strategyToStr(EvalStrategy s) {
+    switch (s) {
+    case EvalStrategy::flatTape:
+        return "flat tape";
+    case EvalStrategy::jetTape:
+        return "jet tape";
+    default:
+        throw "Unknown EvalStrategy";
+    }
+}
+
+// rough cost of one complex operation in ns (fitted on x86-64 with glibc), transcendental functions dominate everything else
+double opCost(TokenType t) {
+    switch (t) {
+    case TokenType::Tconst:
+    case TokenType::Tvariable:
+        return 0.5;
+    case TokenType::Tplus:
+    case TokenType::Tminus:
+        return 1.5;
+    case TokenType::Tmult:
+        return 5;
+    case TokenType::Tdiv:
+        return 15;
+    case TokenType::Tpow: // exp(b * log(a))
+        return 150;
+    case TokenType::Tlog:
+        return 60;
+    case TokenType::Ttan:
+    case TokenType::Tcot:
+        return 100;
+    default: // sin, cos, sinh, cosh
+        return 70;
+    }
+}
+
+// how many times more an operation costs on Dual (order 1) or Jet (order 2) numbers
+double jetFactor(TokenType t, size_t order) {
+    switch (t) {
+    case TokenType::Tconst:
+    case TokenType::Tvariable:
+    case TokenType::Tplus:
+    case TokenType::Tminus:
+        return order + 1.0;
+    case TokenType::Tmult:
+        return order == 1 ? 2 : 4;
+    case TokenType::Tdiv: // the divisions dominate, 2 of them for Dual and 3 for Jet
+        return order == 1 ? 2 : 3;
+    case TokenType::Tpow: // a^b and a^(b-1) (and a^(b-2)) for constant exponents, exp(b * log(a)) otherwise
+        return order == 1 ? 2 : 3;
+    case TokenType::Ttan: // Dual needs cos too, Jet gets everything from tan
+        return order == 1 ? 2 : 1.2;
+    case TokenType::Tcot: // tan followed by a division
+        return order == 1 ? 2.2 : 1.5;
+    case TokenType::Tlog: // log and 1 / a
+        return 1.3;
+    default: // sin and cos (sinh and cosh) of the argument
+        return 2;
+    }
+}
+
+// Static cost of one tree
+struct TreeCost {
+    size_t nodesByType[TokenType::TEND + 1]; // distinct nodes of every TokenType
+    size_t nodes; // distinct nodes: what a flattened evaluation visits, shared subtrees count once
+    double weight; // opCost() over the distinct nodes
+    double jetWeight[3]; // opCost() * jetFactor() over the distinct nodes, per derivative order
+};
+
+TreeCost treeCost(Node* root) {
+    TreeCost res{};
+    for (Node* node : postOrder({ root })) {
+        double w = opCost(node->tokType);
+        ++res.nodesByType[node->tokType];
+        ++res.nodes;
+        res.weight += w;
+        for (size_t order = 1; order < 3; ++order) {
+            res.jetWeight[order] += w * jetFactor(node->tokType, order);
+        }
+    }
+    return res;
+}
+
+// Which strategy evaluates each derivative order, and why
+struct StrategyDecision {
+    TreeCost costs[3]; // f, f' and f'' as diff() builds them
+    double estimated[3][STRATEGYCOUNT]; // [order][strategy] in rough ns, infinity where the strategy does not apply
+    double measured[3][STRATEGYCOUNT]; // ns per evaluation from calibration, 0 without it
+    bool calibrated;
+    EvalStrategy chosen[3];
+
+    string describe() const {
+        string res = "";
+        for (size_t order = 0; order < 3; ++order) {
+            const TreeCost& c = costs[order];
+            res += "order " + to_string(order) + ": " + strategyToStr(chosen[order]) + " (distinct nodes " + to_string(c.nodes) +
+                ", functions " + to_string(c.nodesByType[TokenType::Tsin] + c.nodesByType[TokenType::Tcos] + c.nodesByType[TokenType::Ttan] +
+                    c.nodesByType[TokenType::Tcot] + c.nodesByType[TokenType::Tsinh] + c.nodesByType[TokenType::Tcosh] + c.nodesByType[TokenType::Tlog]) +
+                ", pow " + to_string(c.nodesByType[TokenType::Tpow]) + ";";
+            for (size_t s = 0; s < STRATEGYCOUNT; ++s) {
+                if (isinf(estimated[order][s])) continue;
+                res += " " + strategyToStr((EvalStrategy)s) + " ~" + double_to_str(round(estimated[order][s])) + "ns";
+                if (calibrated) res += "/" + double_to_str(round(measured[order][s])) + "ns measured";
+            }
+            res += ")\n";
+        }
+        return res;
+    }
+};
+
+// f, f' and f'' that evaluate every derivative with the strategy the cost model (and optionally a calibration run) picked.
+// f itself is always evaluated on its flat tape.
+// The model only has the terms that separate the two strategies: the operation mix, and the distinct nodes of each tree,
+// which already accounts for sharing (a shared subtree is one tape entry either way). How often a subtree is walked and
+// the depth only mattered for a tree walk, which never beats the flat tape and is no longer a candidate.
+// Both strategies fail at the same points: the flat tapes of f' and f'' fail where a pow base is 0 (diff() writes (a^b)'
+// with log(a) and a' / a), so the jet tape checks the pow bases too. The message can name a different operation when
+// several fail at the same point, and where only an underflow inside the derivative tree fails (b^2 of a tiny b in
+// (a / b)'), the jet tape still gives a value.
+class AdaptiveExpression {
+private:
+    vector<Tape> tapes; // f, f' and f'' flattened, tapes[0] is also what the jet strategy runs on
+    vector<size_t> powBases; // tapes[0] positions of the bases of pow
+    StrategyDecision chosen;
+
+    // per-node overhead on top of opCost(): one table step
+    static constexpr double TAPEOVERHEAD = 3;
+    static constexpr double CALLOVERHEAD = 15; // scratch lookup and setup of a tape evaluation
+
+    void estimate() {
+        for (size_t order = 0; order < 3; ++order) {
+            const TreeCost& c = chosen.costs[order];
+            chosen.estimated[order][EvalStrategy::flatTape] = c.weight + c.nodes * TAPEOVERHEAD + CALLOVERHEAD;
+            chosen.estimated[order][EvalStrategy::jetTape] = order == 0 ? numeric_limits<double>::infinity()
+                : chosen.costs[0].jetWeight[order] + chosen.costs[0].nodes * TAPEOVERHEAD * (1 + 0.5 * order) + CALLOVERHEAD;
+        }
+    }
+
+    void calibrate(const vector<value_t>& samples) {
+        for (size_t order = 0; order < 3; ++order) {
+            for (size_t s = 0; s < STRATEGYCOUNT; ++s) {
+                if (isinf(chosen.estimated[order][s])) {
+                    chosen.measured[order][s] = numeric_limits<double>::infinity();
+                    continue;
+                }
+                // repeat until the measurement takes at least 100us, but never more than 64 rounds
+                value_t sink = 0;
+                size_t evaluations = 0;
+                auto start = chrono::steady_clock::now();
+                double elapsed = 0;
+                for (size_t round = 0; round < 64 && elapsed < 1e5; ++round) {
+                    for (const value_t& x : samples) {
+                        try {
+                            sink += evalWith((EvalStrategy)s, x, order);
+                        } catch (...) {} // points where f does not exist cost the same for every strategy
+                        ++evaluations;
+                    }
+                    elapsed = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+                }
+                chosen.measured[order][s] = elapsed / evaluations + (sink == value_t(-1, -1) ? 1 : 0); // keeps sink alive
+            }
+        }
+        chosen.calibrated = true;
+    }
+
+    void choose() {
+        for (size_t order = 0; order < 3; ++order) {
+            const double* cost = chosen.calibrated ? chosen.measured[order] : chosen.estimated[order];
+            chosen.chosen[order] = (EvalStrategy)(min_element(cost, cost + STRATEGYCOUNT) - cost);
+        }
+    }
+
+    template <typename T>
+    void checkPowBases(const vector<T>& values) const {
+        for (size_t a : powBases) {
+            if (primal(values[a]) == 0.0) throw "Calculator error: log argument is outside of log's domain";
+        }
+    }
+
+public:
+    // calibrate: also time both strategies on the sample points (a few hundred microseconds per order) and trust that
+    // over the static estimate
+    AdaptiveExpression(const string& eq, bool calibrate = false, const vector<value_t>& samples = { value_t(0.5, 0.5), value_t(-1, 0.25), value_t(1.5, -0.75), value_t(0.1, -1) }) {
+        Lexer myLexer(eq);
+        Parser myParser(myLexer.lex());
+        Node* trees[3];
+        trees[0] = myParser.parse();
+        trees[1] = diff(trees[0]);
+        trees[2] = diff(trees[1]);
+        for (size_t order = 0; order < 3; ++order) {
+            tapes.push_back(Tape(trees[order], 1));
+            chosen.costs[order] = treeCost(trees[order]);
+        }
+        vector<size_t> variableAt(1), outputs;
+        for (const FlatEntry& e : flatten({ trees[0] }, variableAt, outputs)) { // the same positions as on tapes[0]
+            if (e.type == NodeType::binaryOp && e.tokType == TokenType::Tpow) powBases.push_back(e.a);
+        }
+        chosen.calibrated = false;
+        estimate();
+        if (calibrate) this->calibrate(samples);
+        choose();
+    }
+
+    const StrategyDecision& decision() const {
+        return chosen;
+    }
+
+    value_t eval(value_t x, size_t order) const {
+        return evalWith(chosen.chosen[order], x, order);
+    }
+
+    // order 0 is always the flat tape of f
+    value_t evalWith(EvalStrategy strategy, value_t x, size_t order) const {
+        if (order == 0 || strategy == EvalStrategy::flatTape) {
+            static thread_local vector<value_t> scratch;
+            return tapes[order].eval(&x, scratch);
+        }
+        if (strategy != EvalStrategy::jetTape) throw "AdaptiveExpression error: unknown EvalStrategy";
+        if (order == 1) {
+            static thread_local vector<Dual> scratch;
+            Dual seed(x, 1);
+            value_t res = tapes[0].eval(&seed, scratch).d;
+            checkPowBases(scratch);
+            return res;
+        }
+        static thread_local vector<Jet> scratch;
+        Jet seed(x, 1);
+        value_t res = tapes[0].eval(&seed, scratch).dd;
+        checkPowBases(scratch);
+        return res;
+    }
+};
+
+// Like differentiate(), but every order is evaluated with the strategy that suits this expression
+tuple<func_t, func_t, func_t> differentiateAdaptive(const string& eq, bool calibrate = false) {
+    shared_ptr<const AdaptiveExpression> expression = make_shared<const AdaptiveExpression>(eq, calibrate);
+    return {
+        [expression](value_t substitutionValue) {
+            return expression->eval(substitutionValue, 0);
+        },
+        [expression](value_t substitutionValue) {
+            return expression->eval(substitutionValue, 1);
+        },
+        [expression](value_t substitutionValue) {
+            return expression->eval(substitutionValue, 2);
+        }
+    };
+}
+
+// Benchmarks
+
+value_t benchSink; // results are accumulated here so the optimizer cannot drop the measured work
+
+template <typename F>
+double nanosPerCall(F f, size_t reps) {
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < reps; ++i) {
+        benchSink += f();
+    }
+    return chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / reps;
+}
+
+// sum of v(i) * cos(v(i+1)) + v(i)^2 over n variables, every variable appears in two terms
+string gradientBenchExpr(size_t n, vector<string>& variables) {
+    variables.clear();
+    for (size_t i = 0; i < n; ++i) {
+        variables.push_back("v" + to_string(i));
+    }
+    string eq = "";
+    for (size_t i = 0; i < n; ++i) {
+        if (i != 0) eq += " + ";
+        eq += variables[i] + " * cos(" + variables[(i + 1) % n] + ") + " + variables[i] + "^2";
+    }
+    return eq;
+}
+
+void benchGradient() {
+    cout << "Gradient: reverse-mode tape vs one symbolic diff() per variable (ns per full gradient)" << endl;
+    cout << "vars\ttape\tdiff\ttape/var\tdiff/var\thessian" << endl;
+    for (size_t n = 1; n <= 64; n *= 2) {
+        vector<string> variables;
+        string eq = gradientBenchExpr(n, variables);
+        Node* tree = Parser(Lexer(eq, variables).lex()).parse();
+        Tape tape(tree, n);
+        vector<Node*> partials;
+        for (size_t i = 0; i < n; ++i) {
+            partials.push_back(diff(tree, i));
+        }
+        vector<value_t> at;
+        for (size_t i = 0; i < n; ++i) {
+            at.push_back(value_t(0.1 * i + 0.3, 0.2));
+        }
+
+        size_t reps = 200000 / n;
+        double tapeTime = nanosPerCall([&]() { return tape.gradient(at)[0]; }, reps);
+        double diffTime = nanosPerCall([&]() {
+            Calculator myCalculator(at);
+            value_t sum = 0;
+            for (Node* partial : partials) {
+                sum += myCalculator.calc(partial);
+            }
+            return sum;
+        }, reps);
+        double hessianTime = nanosPerCall([&]() { return tape.hessian(at)[0][0]; }, reps / n + 1);
+        cout << n << "\t" << tapeTime << "\t" << diffTime << "\t" << tapeTime / n << "\t" << diffTime / n << "\t" << hessianTime << endl;
+    }
+}
+
+void benchParameters() {
+    const size_t pointCount = 10000;
+    const string model = "a * sin(b * x) + c * x^2 + d * log(x + 5)";
+    vector<value_t> points;
+    for (size_t k = 0; k < pointCount; ++k) {
+        points.push_back(value_t(0.001 * k, 0.5));
+    }
+
+    cout << "Parameter update over " << pointCount << " cached points, f'' of " << model << " (us per update)" << endl;
+    cout << "changed\trecompiled\tincremental\tsubexpressions recomputed/total" << endl;
+
+    CompiledExpression compiled(model, { "x" }, { "a", "b", "c", "d" }, 2);
+    compiled.setPoints(points);
+    compiled.eval();
+    const vector<string> changed = { "a", "b", "c", "d" };
+    for (const string& name : changed) {
+        double value = 1;
+        size_t recomputed = 0;
+        double incremental = nanosPerCall([&]() {
+            value += 0.001;
+            compiled.setParameter(name, value);
+            const vector<value_t>& res = compiled.eval();
+            recomputed = compiled.lastRecomputed();
+            return res[0];
+        }, 100) / 1000;
+
+        // what a fitting loop does today: substitute the constants into the string and start over
+        double recompiled = nanosPerCall([&]() {
+            value += 0.001;
+            string eq = model;
+            for (const string& other : changed) {
+                string constant = double_to_str(other == name ? value : compiled.parameter(other).real());
+                eq.replace(eq.find(other), 1, constant);
+            }
+            Node* tree = diff(diff(Parser(Lexer(eq).lex()).parse()));
+            value_t sum = 0;
+            for (const value_t& point : points) {
+                sum += Calculator(point).calc(tree);
+            }
+            return sum;
+        }, 10) / 1000;
+        cout << name << "\t" << recompiled << "\t" << incremental << "\t" << recomputed << "/" << compiled.size() << endl;
+    }
+}
+
+// Newton fractal style basins: one seed per pixel of a grid over [-2, 2] x [-2, 2]
+vector<value_t> rootBenchSeeds(size_t side) {
+    vector<value_t> seeds;
+    for (size_t i = 0; i < side; ++i) {
+        for (size_t j = 0; j < side; ++j) {
+            seeds.push_back(value_t(-2 + 4.0 * i / side, -2 + 4.0 * j / side));
+        }
+    }
+    return seeds;
+}
+
+void benchRoots() {
+    const size_t side = 256;
+    vector<value_t> seeds = rootBenchSeeds(side);
+    const vector<string> equations = { "x^3 - 1", "sin(x) - x / 2 + cos(3 * x)" };
+    unsigned cores = max(1u, thread::hardware_concurrency());
+
+    cout << "Root finding from " << seeds.size() << " seeds (ms), per-seed loop over differentiate() vs findRoots()" << endl;
+    cout << "method\tloop\t1 thread\t" << cores << " threads\tavg iterations\tconverged" << endl;
+    for (const string& eq : equations) {
+        cout << eq << endl;
+        for (RootMethod method : { RootMethod::newton, RootMethod::halley }) {
+            const auto f = differentiate(eq);
+            double loop = nanosPerCall([&]() {
+                value_t sum = 0;
+                for (value_t x : seeds) {
+                    try {
+                        for (size_t iteration = 0; iteration < 100; ++iteration) {
+                            value_t fx = get<0>(f)(x);
+                            if (fx == 0.0) break;
+                            value_t fp = get<1>(f)(x);
+                            value_t step = method == RootMethod::halley
+                                ? 2.0 * fx * fp / (2.0 * fp * fp - fx * get<2>(f)(x))
+                                : fx / fp;
+                            x -= step;
+                            if (!isFinite(step) || abs(step) <= 1e-12 * max(1.0, abs(x))) break;
+                        }
+                    } catch (...) {}
+                    sum += x;
+                }
+                return sum;
+            }, 1) / 1e6;
+
+            vector<RootResult> res;
+            double single = nanosPerCall([&]() { res = findRoots(eq, seeds, method, 100, 1e-12, 1); return res[0].root; }, 1) / 1e6;
+            double parallel = nanosPerCall([&]() { res = findRoots(eq, seeds, method); return res[0].root; }, 1) / 1e6;
+            size_t iterations = 0, converged = 0;
+            for (const RootResult& r : res) {
+                iterations += r.iterations;
+                converged += r.converged;
+            }
+            cout << (method == RootMethod::halley ? "halley" : "newton") << "\t" << loop << "\t" << single << "\t" << parallel << "\t"
+                << (double)iterations / res.size() << "\t" << converged << endl;
+        }
+    }
+}
+
+void benchSurrogate() {
+    const vector<string> equations = {
+        "x^3 - 2*x + 1",
+        "sin(x) * cosh(x) + log(x + 3)",
+        "tan(2 * x) / (x^2 + 4) + x^x" // poles of tan and the branch cut of x^x inside the disk
+    };
+    const SurrogateRegion region{ RegionShape::disk, value_t(0.5, 0.5), value_t(1, 0) };
+    const double tolerance = 1e-9;
+    vector<value_t> points;
+    for (size_t k = 0; k < 10000; ++k) {
+        points.push_back(region.center + polar(0.99 * sqrt((k % 97) / 97.0), k * 2.39996)); // spread over the disk
+    }
+
+    cout << "Surrogate over the disk |x - (0.5,0.5)| <= 1, tolerance " << tolerance << endl;
+    cout << "build ms\tcells\texact cells\toracle calls\torder\texact ns\tsurrogate ns\tspeedup\tbreak-even evals\tmax rel error" << endl;
+    for (const string& eq : equations) {
+        cout << eq << endl;
+        Surrogate* surrogate = nullptr;
+        double build = nanosPerCall([&]() {
+            surrogate = new Surrogate(eq, region, tolerance);
+            return value_t(0);
+        }, 1) / 1e6;
+        vector<Node*> trees = { Parser(Lexer(eq).lex()).parse() };
+        trees.push_back(diff(trees[0]));
+        trees.push_back(diff(trees[1]));
+        const Tape exactTape(trees, 1); // the exact path the surrogate falls back to, and what differentiate() runs f' and f'' on
+        vector<value_t> scratch;
+        for (size_t order = 0; order < 3; ++order) {
+            size_t k = 0;
+            double exact = nanosPerCall([&]() {
+                try {
+                    return exactTape.eval(&points[k++ % points.size()], scratch, order);
+                } catch (...) {
+                    return value_t(0);
+                }
+            }, points.size());
+            k = 0;
+            double approx = nanosPerCall([&]() {
+                try {
+                    return surrogate->eval(points[k++ % points.size()], order);
+                } catch (...) {
+                    return value_t(0);
+                }
+            }, points.size());
+            double maxError = 0;
+            for (const value_t& x : points) {
+                try {
+                    value_t y = exactTape.eval(&x, scratch, order);
+                    maxError = max(maxError, abs(surrogate->eval(x, order) - y) / max(1.0, abs(y)));
+                } catch (...) {} // not tested where the exact value does not exist
+            }
+            cout << build << "\t" << surrogate->cellCount() << "\t" << surrogate->exactCellCount() << "\t" << surrogate->oracleCallCount() << "\t"
+                << order << "\t" << exact << "\t" << approx << "\t" << exact / approx << "\t" << build * 1e6 / (exact - approx) << "\t" << maxError << endl;
+        }
+        delete surrogate;
+    }
+}
+
+// Machine-generated style inputs that are n levels deep
+string deepExpr(const string& kind, size_t n) {
+    string eq = "";
+    if (kind == "tower") { // 1.000001^(1.000001^(...^x)), right-associative
+        for (size_t i = 0; i < n; ++i) eq += "1.000001^";
+        return eq + "x";
+    }
+    if (kind == "functions") { // sin(cos(sin(...x)))
+        for (size_t i = 0; i < n; ++i) eq += i % 2 ? "cos(" : "sin(";
+        return eq + "x" + string(n, ')');
+    }
+    if (kind == "parens") { // ((x)*0.5+1)*0.5+1 ...
+        eq = string(n, '(') + "x";
+        for (size_t i = 0; i < n; ++i) eq += ")*0.5+1";
+        return eq;
+    }
+    // left-associative chain x*0.5+x*0.5+... is as deep as it is long
+    eq = "x";
+    for (size_t i = 0; i < n; ++i) eq += "+x*0.5";
+    return eq;
+}
+
+void benchDeep() {
+    cout << "Deep expressions (ms), the build steps and then differentiate() as callers use it (the first f' call flattens f' and f'')" << endl;
+    cout << "kind\tdepth\tlex\tparse\tdiff\tdiff2\tdifferentiate\tf\tf'\tf''\tf''(x)\tnodes f''" << endl;
+    for (const string kind : { "tower", "functions", "parens", "chain" }) {
+        for (size_t n = 1000; n <= 100000; n *= 10) {
+            string eq = deepExpr(kind, n);
+            vector<Token> tokens;
+            Node* tree = nullptr;
+            Node* first = nullptr;
+            Node* second = nullptr;
+            double lexTime = nanosPerCall([&]() { tokens = Lexer(eq).lex(); return value_t(0); }, 1) / 1e6;
+            double parseTime = nanosPerCall([&]() { tree = Parser(tokens).parse(); return value_t(0); }, 1) / 1e6;
+            double diffTime = nanosPerCall([&]() { first = diff(tree); return value_t(0); }, 1) / 1e6;
+            double diff2Time = nanosPerCall([&]() { second = diff(first); return value_t(0); }, 1) / 1e6;
+            tuple<func_t, func_t, func_t> f;
+            double differentiateTime = nanosPerCall([&]() { f = differentiate(eq); return value_t(0); }, 1) / 1e6;
+            value_t x(0.5, 0.25);
+            value_t res;
+            double times[3];
+            for (size_t order = 0; order < 3; ++order) {
+                const func_t& g = order == 0 ? get<0>(f) : order == 1 ? get<1>(f) : get<2>(f);
+                times[order] = nanosPerCall([&]() { return res = g(x); }, 1) / 1e6;
+            }
+            cout << kind << "\t" << n << "\t" << lexTime << "\t" << parseTime << "\t" << diffTime << "\t" << diff2Time << "\t"
+                << differentiateTime << "\t" << times[0] << "\t" << times[1] << "\t" << times[2] << "\t" << res << "\t"
+                << postOrder({ second }).size() << endl;
+        }
+    }
+}
+
+void benchPrecision() {
+    const vector<string> equations = {
+        "x*x*x*x*x - 3*x*x*x + 2*x*x - x + 1", // only + - *, where float's wider SIMD pays off
+        "x^3 - 2*x + 1",
+        "sin(x) * cosh(x) + log(x + 3)",
+        "tan(2 * x) / (x^2 + 4) + x^x",
+        "(x + 1000)*(x + 1000) - 2000 * x - 1000000" // cancellation: equal to x^2
+    };
+    const double threshold = 1e-4;
+    vector<value_t> points = rootBenchSeeds(512);
+
+    cout << "f, f', f'' at " << points.size() << " points: double vs complex<float> vs mixed (threshold " << threshold << ")" << endl;
+    cout << "Mpoints/s double\tfloat\tmixed\tmax rel error float\tmixed\tre-evaluated" << endl;
+    for (const string& eq : equations) {
+        cout << eq << endl;
+        vector<Node*> roots = loweredDiffTrees(eq); // the same program in all three, what MixedPrecisionProgram(eq) evaluates
+        FusedProgram full(roots);
+        BasicFusedProgram<complex<float>> single(roots);
+        MixedPrecisionProgram mixed(eq, threshold);
+
+        vector<complex<float>> singlePoints(points.begin(), points.end());
+        vector<vector<value_t>> reference, mixedRes;
+        vector<vector<complex<float>>> singleRes;
+        size_t reevaluated = 0;
+        double fullTime = nanosPerCall([&]() { reference = full.evalAll(points); return reference[0][0]; }, 3);
+        double singleTime = nanosPerCall([&]() { singleRes = single.evalAll(singlePoints); return value_t(singleRes[0][0]); }, 3);
+        double mixedTime = nanosPerCall([&]() { reevaluated = mixed.evalAll(points, mixedRes); return mixedRes[0][0]; }, 3);
+
+        double singleError = 0, mixedError = 0;
+        for (size_t r = 0; r < roots.size(); ++r) {
+            for (size_t k = 0; k < points.size(); ++k) {
+                value_t y = reference[r][k];
+                if (!isFinite(y)) continue;
+                singleError = max(singleError, abs(value_t(singleRes[r][k]) - y) / max(1.0, abs(y)));
+                mixedError = max(mixedError, abs(mixedRes[r][k] - y) / max(1.0, abs(y)));
+            }
+        }
+        cout << points.size() * 1e3 / fullTime << "\t" << points.size() * 1e3 / singleTime << "\t" << points.size() * 1e3 / mixedTime << "\t"
+            << singleError << "\t" << mixedError << "\t";
+        if (mixed.inSingle()) {
+            cout << 100.0 * reevaluated / points.size() << "%" << endl;
+        } else {
+            cout << "double only" << endl;
+        }
+    }
+}
+
+// false if the model's picks are not faster in total than the best fixed strategy
+bool benchStrategies() {
+    vector<string> corpus = {
+        "2 * x^3",
+        "x^4 + 3*x^2",
+        "3*x + 2*x",
+        "sin(cos(3*x))",
+        "tan(sin(x+3)+x)",
+        "cot(log(x+9)+3*x)",
+        "sin(x)*cos(x)*tan(x)*sinh(x)",
+        "x^x^x",
+        "(x^2 + 1) / (x^3 - 2*x + 5)",
+        "tan(x/x^x*x^x-x^(x^x)/cos(63.5+40.1)^x/(10.5^x/x^88+54.3^57.9*x^2.1/x-47.1^9.5))",
+        "log(x + 1) + log(x + 2) + log(x + 3) + log(x + 4)",
+        "sin(x) + sin(2*x) + sin(3*x) + sin(4*x)",
+        "log(x^2 + 1) + log(x^2 + 2) + log(x^2 + 3)",
+        deepExpr("functions", 40),
+        deepExpr("tower", 8),
+        deepExpr("chain", 200)
+    };
+    vector<value_t> points;
+    for (size_t k = 0; k < 32; ++k) {
+        points.push_back(polar(0.3 + 0.05 * k, 0.7 * k));
+    }
+
+    // f is always evaluated on its flat tape, so only f' and f'' have a choice
+    cout << "Evaluation strategy per expression and derivative order (ns per evaluation)" << endl;
+    cout << "order\tflat tape\tjet tape\tmodel pick\tcalibrated pick" << endl;
+    double fixedTotal[STRATEGYCOUNT] = {};
+    double modelTotal = 0, calibratedTotal = 0, bestTotal = 0;
+    for (const string& eq : corpus) {
+        cout << (eq.size() > 60 ? eq.substr(0, 57) + "..." : eq) << endl;
+        AdaptiveExpression expression(eq);
+        AdaptiveExpression calibrated(eq, true);
+        for (size_t order = 1; order < 3; ++order) {
+            double time[STRATEGYCOUNT];
+            for (size_t s = 0; s < STRATEGYCOUNT; ++s) {
+                size_t k = 0;
+                time[s] = nanosPerCall([&]() {
+                    try {
+                        return expression.evalWith((EvalStrategy)s, points[k++ % points.size()], order);
+                    } catch (...) {
+                        return value_t(0);
+                    }
+                }, 100 * points.size());
+                fixedTotal[s] += time[s];
+            }
+            EvalStrategy modelPick = expression.decision().chosen[order];
+            EvalStrategy calibratedPick = calibrated.decision().chosen[order];
+            modelTotal += time[modelPick];
+            calibratedTotal += time[calibratedPick];
+            bestTotal += *min_element(time, time + STRATEGYCOUNT);
+            cout << order << "\t" << time[0] << "\t" << time[1] << "\t"
+                << strategyToStr(modelPick) << "\t" << strategyToStr(calibratedPick) << endl;
+        }
+    }
+    cout << "corpus total: always flat tape " << fixedTotal[EvalStrategy::flatTape] << ", always jet tape " << fixedTotal[EvalStrategy::jetTape]
+        << ", model " << modelTotal << ", calibrated " << calibratedTotal << ", best possible " << bestTotal << endl;
+    size_t bestFixed = min_element(fixedTotal, fixedTotal + STRATEGYCOUNT) - fixedTotal;
+    cout << "speedup over always " << strategyToStr((EvalStrategy)bestFixed) << " (the best fixed strategy): model "
+        << fixedTotal[bestFixed] / modelTotal << "x, calibrated " << fixedTotal[bestFixed] / calibratedTotal
+        << "x, best possible " << fixedTotal[bestFixed] / bestTotal << "x" << endl;
+    bool passed = modelTotal < fixedTotal[bestFixed];
+    cout << (passed ? "PASS" : "FAIL") << ": the model's total is " << (passed ? "" : "not ") << "below always "
+        << strategyToStr((EvalStrategy)bestFixed) << endl;
+    return passed;
+}
+
+// false if a benchmark's check failed
+bool runBenchmarks(const string& which) {
+    bool passed = true;
+    if (which == "" || which == "gradient") benchGradient();
+    if (which == "" || which == "parameters") benchParameters();
+    if (which == "" || which == "roots") benchRoots();
+    if (which == "" || which == "surrogate") benchSurrogate();
+    if (which == "" || which == "deep") benchDeep();
+    if (which == "" || which == "precision") benchPrecision();
+    if (which == "" || which == "strategies") passed = benchStrategies() && passed;
+    cout << "(sink " << benchSink << ")" << endl;
+    return passed;
+}
+
+// Evaluation daemon: a long-running process that keeps compiled expressions in a shared cache and answers evaluation
+// requests over a Unix domain socket. Concurrent requests for the same expression are coalesced into one batch.
+//
+// Protocol (native byte order, the socket is local):
+//   request:  u8 evalMessage, u8 orders (bit 0: f, bit 1: f', bit 2: f''), u32 expression length, the expression,
+//             u32 point count, then point count * (double re, double im)
+//             u8 statsMessage
+//   response: u8 responseOk, u32 value count, then for every requested order (f first) the values at every point
+//             u8 responseError, u32 length, message
+// Evaluation is unchecked: where f does not exist the response holds inf or nan. A request with a longer expression than
+// EvalServer::MAXEXPRESSIONLENGTH or more points than EvalServer::MAXPOINTS gets responseError and the connection is
+// closed, because the rest of the request cannot be skipped.
+
+#ifndef _WIN32
+
+enum MessageType {
+    evalMessage = 1,
+    statsMessage = 2
+};
+
+enum ResponseStatus {
+    responseOk = 0,
+    responseError = 1
+};
+
+bool readAll(int fd, void* buf, size_t n) {
+    char* p = (char*)buf;
+    while (n > 0) {
+        ssize_t got = read(fd, p, n);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+        p += got;
+        n -= got;
+    }
+    return true;
+}
+
+bool writeAll(int fd, const void* buf, size_t n) {
+    const char* p = (const char*)buf;
+    while (n > 0) {
+        ssize_t sent = write(fd, p, n);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) return false;
+        p += sent;
+        n -= sent;
+    }
+    return true;
+}
+
+// outgoing message, written with a single write()
+class MessageBuffer {
+private:
+    vector<char> bytes;
+public:
+    template <typename T>
+    void put(const T& value) {
+        const char* p = (const char*)&value;
+        bytes.insert(bytes.end(), p, p + sizeof(T));
+    }
+
+    void put(const void* data, size_t n) {
+        bytes.insert(bytes.end(), (const char*)data, (const char*)data + n);
+    }
+
+    void putString(const string& s) {
+        put((uint32_t)s.size());
+        put(s.data(), s.size());
+    }
+
+    bool send(int fd) {
+        bool ok = writeAll(fd, bytes.data(), bytes.size());
+        bytes.clear();
+        return ok;
+    }
+};
+
+size_t orderCount(uint8_t orders) {
+    return (orders & 1) + ((orders >> 1) & 1) + ((orders >> 2) & 1);
+}
+
+sockaddr_un socketAddress(const string& path) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) throw "Socket error: path too long";
+    copy(path.begin(), path.end(), addr.sun_path);
+    return addr;
+}
+
+class EvalServer {
+private:
+    struct Request {
+        const vector<value_t>* points;
+        vector<value_t>* results; // f, f' and f'' at every point, one after the other
+        bool done;
+        bool failed;
+    };
+
+    // one cached expression, with the requests waiting for the next batch
+    struct CompiledEntry {
+        FusedProgram program;
+        mutex lock;
+        condition_variable finished;
+        vector<Request*> pending;
+        bool evaluating = false;
+
+        CompiledEntry(const vector<Node*>& roots) : program(roots) {}
+    };
+
+    string socketPath;
+    int listenFd = -1;
+    thread acceptor;
+    atomic<bool> stopping;
+
+    // connection threads are detached, stop() waits until activeConnections is back to 0
+    mutex connectionsLock;
+    condition_variable connectionsDone;
+    vector<int> connectionFds; // open connections, removed before they are closed
+    size_t activeConnections = 0;
+
+    // least recently used expressions are evicted beyond MAXCACHEDEXPRESSIONS, requests still running on them keep their
+    // entry alive through the shared_ptr
+    struct CacheSlot {
+        shared_ptr<CompiledEntry> entry;
+        list<const string*>::iterator recent;
+    };
+    mutable mutex cacheLock;
+    unordered_map<string, CacheSlot> cache;
+    list<const string*> recentlyUsed; // keys of cache, most recently used first
+
+    chrono::steady_clock::time_point started;
+    atomic<uint64_t> requests, points, batches, batchedRequests, cacheHits, cacheMisses, cacheEvictions, errors;
+    atomic<uint64_t> latencyBuckets[32]; // bucket i counts requests that took less than 2^i microseconds
+
+    shared_ptr<CompiledEntry> compiled(const string& eq) {
+        {
+            lock_guard<mutex> guard(cacheLock);
+            auto it = cache.find(eq);
+            if (it != cache.end()) {
+                ++cacheHits;
+                recentlyUsed.splice(recentlyUsed.begin(), recentlyUsed, it->second.recent);
+                return it->second.entry;
+            }
+        }
+        ++cacheMisses;
+        // compiled outside of the lock, so a large expression does not hold up the others
+        Lexer myLexer(eq);
+        Parser myParser(myLexer.lex());
+        Node* eqTree = myParser.parse();
+        Node* firstDiffTree = diff(eqTree);
+        vector<Node*> roots{ eqTree, firstDiffTree, diff(firstDiffTree) };
+        shared_ptr<CompiledEntry> entry;
+        try {
+            entry = make_shared<CompiledEntry>(roots);
+        } catch (...) {
+            deleteTrees(roots);
+            throw;
+        }
+        deleteTrees(roots); // the program has its own flat copy
+        lock_guard<mutex> guard(cacheLock);
+        auto inserted = cache.emplace(eq, CacheSlot{ entry, recentlyUsed.end() });
+        if (!inserted.second) return inserted.first->second.entry; // another connection was faster, keep its entry
+        recentlyUsed.push_front(&inserted.first->first);
+        inserted.first->second.recent = recentlyUsed.begin();
+        while (cache.size() > MAXCACHEDEXPRESSIONS) {
+            cache.erase(cache.find(*recentlyUsed.back())); // by iterator, the key lives in the erased element
+            recentlyUsed.pop_back();
+            ++cacheEvictions;
+        }
+        return entry;
+    }
+
+    void runBatch(const FusedProgram& program, const vector<Request*>& batch) {
+        vector<value_t> all;
+        for (const Request* r : batch) {
+            all.insert(all.end(), r->points->begin(), r->points->end());
+        }
+        vector<vector<value_t>> res = program.evalAll(all);
+        size_t offset = 0;
+        for (Request* r : batch) {
+            size_t n = r->points->size();
+            r->results->resize(3 * n);
+            for (size_t order = 0; order < 3; ++order) {
+                copy(res[order].begin() + offset, res[order].begin() + offset + n, r->results->begin() + order * n);
+            }
+            offset += n;
+        }
+        ++batches;
+        batchedRequests += batch.size();
+    }
+
+    // Flat combining: a request that finds nobody evaluating its expression evaluates everything queued for it so far,
+    // the others wait for that batch (or the next one). No timer, so a lone request is never delayed.
+    void evaluate(CompiledEntry& entry, const vector<value_t>& at, vector<value_t>& results) {
+        Request request{ &at, &results, false, false };
+        unique_lock<mutex> guard(entry.lock);
+        entry.pending.push_back(&request);
+        while (!request.done) {
+            if (entry.evaluating) {
+                entry.finished.wait(guard);
+                continue;
+            }
+            entry.evaluating = true;
+            vector<Request*> batch;
+            batch.swap(entry.pending);
+            guard.unlock();
+            bool failed = false;
+            try {
+                runBatch(entry.program, batch);
+            } catch (const exception&) { // out of memory: the batch fails, the entry has to stay usable for the others
+                failed = true;
+            }
+            guard.lock();
+            for (Request* r : batch) {
+                r->done = true;
+                r->failed = failed;
+            }
+            entry.evaluating = false;
+            entry.finished.notify_all();
+        }
+        if (request.failed) throw "Server error: evaluation failed";
+    }
+
+    void recordLatency(chrono::steady_clock::time_point start) {
+        double us = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+        size_t bucket = 0;
+        while (bucket < 31 && us >= (double)(1ull << bucket)) ++bucket;
+        ++latencyBuckets[bucket];
+    }
+
+    double latencyPercentile(double p) const {
+        uint64_t total = 0;
+        for (const atomic<uint64_t>& b : latencyBuckets) total += b;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < 32; ++i) {
+            seen += latencyBuckets[i];
+            if (total > 0 && seen >= p * total) return (double)(1ull << i);
+        }
+        return 0;
+    }
+
+    bool sendError(int fd, MessageBuffer& out, const string& message) {
+        ++errors;
+        out.put((uint8_t)ResponseStatus::responseError);
+        out.putString(message);
+        return out.send(fd);
+    }
+
+    void serveConnection(int fd) {
+        vector<value_t> at, results;
+        string eq;
+        MessageBuffer out;
+        while (true) {
+            uint8_t type;
+            if (!readAll(fd, &type, 1)) break;
+            if (type == MessageType::statsMessage) {
+                out.put((uint8_t)ResponseStatus::responseOk);
+                out.putString(stats());
+                if (!out.send(fd)) break;
+                continue;
+            }
+            if (type != MessageType::evalMessage) break; // not our protocol, drop the connection
+
+            uint8_t orders;
+            uint32_t eqLength, pointCount;
+            if (!readAll(fd, &orders, 1) || !readAll(fd, &eqLength, 4)) break;
+            if (eqLength > MAXEXPRESSIONLENGTH) {
+                sendError(fd, out, "Request error: expression too long");
+                break;
+            }
+            eq.resize(eqLength);
+            if (eqLength > 0 && !readAll(fd, &eq[0], eqLength)) break;
+            if (!readAll(fd, &pointCount, 4)) break;
+            if (pointCount > MAXPOINTS) {
+                sendError(fd, out, "Request error: too many points");
+                break;
+            }
+            at.resize(pointCount);
+            if (!readAll(fd, at.data(), pointCount * sizeof(value_t))) break;
+            auto start = chrono::steady_clock::now();
+
+            try {
+                evaluate(*compiled(eq), at, results);
+            } catch (const char* message) {
+                if (!sendError(fd, out, message)) break;
+                continue;
+            } catch (const exception& e) { // out of memory compiling a huge expression, the request was read completely
+                if (!sendError(fd, out, string("Server error: ") + e.what())) break;
+                continue;
+            }
+            out.put((uint8_t)ResponseStatus::responseOk);
+            out.put((uint32_t)(orderCount(orders) * pointCount));
+            for (size_t order = 0; order < 3; ++order) {
+                if (orders & (1 << order)) out.put(&results[order * pointCount], pointCount * sizeof(value_t));
+            }
+            ++requests;
+            points += pointCount;
+            recordLatency(start);
+            if (!out.send(fd)) break;
+        }
+    }
+
+    void handle(int fd) {
+        try {
+            serveConnection(fd);
+        } catch (const exception&) {} // whatever one client does, it only loses its own connection
+        lock_guard<mutex> guard(connectionsLock);
+        connectionFds.erase(find(connectionFds.begin(), connectionFds.end(), fd));
+        close(fd); // under the lock, so stop() never shuts down an fd number that was reused
+        --activeConnections;
+        connectionsDone.notify_all();
+    }
+
+    void acceptLoop() {
+        chrono::milliseconds backOff(1);
+        while (!stopping) {
+            int fd = accept(listenFd, nullptr, nullptr);
+            if (fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                if (errno == EMFILE || errno == ENFILE) { // the pending connection stays queued until a descriptor is free
+                    this_thread::sleep_for(backOff);
+                    backOff = min(backOff * 2, chrono::milliseconds(100));
+                    continue;
+                }
+                break; // the listening socket was shut down by stop()
+            }
+            backOff = chrono::milliseconds(1);
+            lock_guard<mutex> guard(connectionsLock);
+            try {
+                thread(&EvalServer::handle, this, fd).detach(); // it waits for connectionsLock before cleaning up
+            } catch (const exception&) { // out of threads: refuse this connection, keep serving the open ones
+                close(fd);
+                continue;
+            }
+            connectionFds.push_back(fd);
+            ++activeConnections;
+        }
+    }
+
+public:
+    static const uint32_t MAXEXPRESSIONLENGTH = 1 << 20;
+    static const uint32_t MAXPOINTS = 1 << 20; // 16 MB of points, 48 MB of results
+    static const size_t MAXCACHEDEXPRESSIONS = 1024;
+
+    EvalServer(const string& socketPath) : socketPath(socketPath), stopping(false),
+        requests(0), points(0), batches(0), batchedRequests(0), cacheHits(0), cacheMisses(0), cacheEvictions(0), errors(0) {
+        for (atomic<uint64_t>& b : latencyBuckets) b = 0;
+    }
+
+    ~EvalServer() {
+        stop();
+    }
+
+    void start() {
+        sockaddr_un addr = socketAddress(socketPath);
+        unlink(socketPath.c_str()); // left behind by a previous run
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) throw "Socket error: cannot create socket";
+        if (bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+            close(fd);
+            throw "Socket error: cannot bind";
+        }
+        if (listen(fd, 128) != 0) {
+            close(fd);
+            throw "Socket error: cannot listen";
+        }
+        listenFd = fd; // only now, so stop() does not clean up after a failed start()
+        stopping = false;
+        started = chrono::steady_clock::now();
+        acceptor = thread(&EvalServer::acceptLoop, this);
+    }
+
+    void stop() {
+        if (listenFd < 0) return;
+        stopping = true;
+        shutdown(listenFd, SHUT_RDWR);
+        if (acceptor.joinable()) acceptor.join();
+        close(listenFd);
+        listenFd = -1;
+        unique_lock<mutex> guard(connectionsLock);
+        for (int fd : connectionFds) {
+            shutdown(fd, SHUT_RDWR); // still open: handle() removes its fd before closing it
+        }
+        connectionsDone.wait(guard, [this]() { return activeConnections == 0; });
+        unlink(socketPath.c_str());
+    }
+
+    size_t cacheSize() const {
+        lock_guard<mutex> guard(cacheLock);
+        return cache.size();
+    }
+
+    string stats() const {
+        double uptime = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+        string res = "";
+        res += "uptime s: " + to_string(uptime) + "\n";
+        res += "requests: " + to_string(requests) + " (" + to_string(requests / uptime) + "/s)\n";
+        res += "points: " + to_string(points) + " (" + to_string(points / uptime) + "/s)\n";
+        res += "batches: " + to_string(batches) + " (" + to_string(batches > 0 ? (double)batchedRequests / batches : 0) + " requests per batch)\n";
+        res += "cache hits: " + to_string(cacheHits) + ", misses: " + to_string(cacheMisses) + ", evictions: " + to_string(cacheEvictions) +
+            " (" + to_string(cacheSize()) + " cached), errors: " + to_string(errors) + "\n";
+        res += "latency us: p50 < " + double_to_str(latencyPercentile(0.5)) + ", p99 < " + double_to_str(latencyPercentile(0.99)) + "\n";
+        return res;
+    }
+};
+
+class EvalClient {
+private:
+    int fd;
+
+    string readString() {
+        uint32_t length;
+        if (!readAll(fd, &length, 4)) throw "EvalClient error: connection lost";
+        string res(length, '\0');
+        if (length > 0 && !readAll(fd, &res[0], length)) throw "EvalClient error: connection lost";
+        return res;
+    }
+
+public:
+    EvalClient(const string& socketPath) {
+        sockaddr_un addr = socketAddress(socketPath);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0 || connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+            if (fd >= 0) close(fd);
+            throw "EvalClient error: cannot connect";
+        }
+    }
+
+    EvalClient(const EvalClient&) = delete;
+    EvalClient& operator=(const EvalClient&) = delete;
+
+    ~EvalClient() {
+        close(fd);
+    }
+
+    // results hold the requested orders one after the other, throws the server's message on a bad expression
+    void eval(const string& eq, uint8_t orders, const vector<value_t>& at, vector<value_t>& results) {
+        MessageBuffer out;
+        out.put((uint8_t)MessageType::evalMessage);
+        out.put(orders);
+        out.putString(eq);
+        out.put((uint32_t)at.size());
+        out.put(at.data(), at.size() * sizeof(value_t));
+        out.send(fd); // if this fails the server may still have answered before closing (a request over its limits)
+
+        uint8_t status;
+        if (!readAll(fd, &status, 1)) throw "EvalClient error: connection lost";
+        if (status != ResponseStatus::responseOk) {
+            static thread_local string message; // the repo's errors are string literals, this keeps the pointer valid
+            message = readString();
+            throw message.c_str();
+        }
+        uint32_t count;
+        if (!readAll(fd, &count, 4)) throw "EvalClient error: connection lost";
+        results.resize(count);
+        if (!readAll(fd, results.data(), count * sizeof(value_t))) throw "EvalClient error: connection lost";
+    }
+
+    string stats() {
+        uint8_t type = MessageType::statsMessage;
+        uint8_t status;
+        if (!writeAll(fd, &type, 1) || !readAll(fd, &status, 1)) throw "EvalClient error: connection lost";
+        return readString();
+    }
+};
+
+// Many short-lived workers hammering the daemon: every client thread keeps a connection and sends requests back to back
+void runLoadGenerator(const string& socketPath, size_t clients, size_t requestCount, size_t pointCount, const string& eq) {
+    vector<vector<double>> latencies(clients);
+    vector<thread> threads;
+    auto start = chrono::steady_clock::now();
+    for (size_t c = 0; c < clients; ++c) {
+        threads.emplace_back([&, c]() {
+            try {
+                EvalClient client(socketPath);
+                vector<value_t> at(pointCount), results;
+                for (size_t i = 0; i < requestCount; ++i) {
+                    for (size_t k = 0; k < pointCount; ++k) {
+                        at[k] = value_t(0.001 * ((c * 7919 + i * 104729 + k) % 2000) - 1, 0.5);
+                    }
+                    auto sent = chrono::steady_clock::now();
+                    client.eval(eq, 7, at, results);
+                    latencies[c].push_back(chrono::duration<double, micro>(chrono::steady_clock::now() - sent).count());
+                }
+            } catch (const char* message) {
+                cout << message << endl;
+            }
+        });
+    }
+    for (thread& t : threads) {
+        t.join();
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    vector<double> all;
+    for (const vector<double>& l : latencies) {
+        all.insert(all.end(), l.begin(), l.end());
+    }
+    sort(all.begin(), all.end());
+    if (all.empty()) return;
+    cout << clients << " clients x " << requestCount << " requests x " << pointCount << " points of " << eq << endl;
+    cout << "requests/s: " << all.size() / seconds << ", points/s: " << all.size() * pointCount / seconds << endl;
+    cout << "latency us: p50 " << all[all.size() / 2] << ", p99 " << all[all.size() * 99 / 100] << endl;
+
+    // what every short-lived worker pays without the daemon: compile, then evaluate its handful of points
+    double local = nanosPerCall([&]() {
+        const auto f = differentiate(eq);
+        value_t sum = 0;
+        for (size_t k = 0; k < pointCount; ++k) {
+            value_t x(0.001 * k - 1, 0.5);
+            sum += get<0>(f)(x) + get<1>(f)(x) + get<2>(f)(x);
+        }
+        return sum;
+    }, 100) / 1000;
+    cout << "in-process differentiate() + evaluation per request: " << local << " us" << endl;
+    cout << "server stats:" << endl << EvalClient(socketPath).stats();
+}
+
+#endif
+
+int main(int argc, char* argv[]) {
+
+    if (argc > 1 && string(argv[1]) == "bench") {
+        return runBenchmarks(argc > 2 ? argv[2] : "") ? 0 : 1;
+    }
+
+    if (argc > 2 && (string(argv[1]) == "serve" || string(argv[1]) == "load")) {
+#ifndef _WIN32
+        signal(SIGPIPE, SIG_IGN); // a client going away must not kill the process
+        try {
+            if (string(argv[1]) == "serve") { // serve <socket path>
+                EvalServer server(argv[2]);
+                server.start();
+                cout << "serving on " << argv[2] << endl;
+                while (true) {
+                    this_thread::sleep_for(chrono::seconds(60));
+                    cout << server.stats() << endl;
+                }
+            }
+            // load <socket path> [clients] [requests per client] [points per request] [expression]
+            runLoadGenerator(argv[2],
+                argc > 3 ? stoul(argv[3]) : 8,
+                argc > 4 ? stoul(argv[4]) : 1000,
+                argc > 5 ? stoul(argv[5]) : 16,
+                argc > 6 ? argv[6] : "sin(x) * x^2 + log(x + 3)");
+        } catch (const char* message) {
+            cout << message << endl;
+            return 1;
+        }
+#else
+        cout << "The evaluation daemon needs Unix domain sockets" << endl;
+#endif
+        return 0;
+    }
+
+    {
+        /*TestSuit<string> s("Lexer");
+
+        s.isEq(
+            tokenVecToString(Lexer("421").lex()),
+            "constant 421\nENDOFFILE\n",
+            "integer number");
+        s.isEq(
+            tokenVecToString(Lexer("301.875").lex()),
+            "constant 301.875\nENDOFFILE\n",
+            "rational number");
+        s.isEq(
+            tokenVecToString(Lexer("sin cos + tan cot 10 ^ log x").lex()),
+            "sin\ncos\nplus\ntan\ncot\nconstant 10\npow\nlog\nvariable\nENDOFFILE\n",
+            "functions with variables and contants");
+        s.isEq(
             tokenVecToString(Lexer("7+ cos(2 + x) ^2* 3 - 5.234").lex()),
             "constant 7\nplus\ncos\nlParen\nconstant 2\nplus\nvariable\nrParen\npow\nconstant 2\nmult\nconstant 3\nminus\nconstant 5.234\nENDOFFILE\n",
             "full math expr");
@@ -827,5 +3359,220 @@ int main() {
         cout << Calculator(value_t(6.04, 8.62)).calc(diff(Parser(Lexer("tan(x/x^x*x^x-x^(x^x)/cos(63.5+40.1)^x/(10.5^x/x^88+54.3^57.9*x^2.1/x-47.1^9.5))").lex()).parse())) << endl;
     }
 
+    {
+        cout << "Testing multiple variables:" << endl;
+        vector<string> vars = { "x", "y", "a", "b" };
+        cout << parseTreeToString(Parser(Lexer("a*x^2 + b*y", vars).lex()).parse(), vars) << endl;
+        cout << parseTreeToString(diff(Parser(Lexer("a*x^2 + b*y", vars).lex()).parse(), 1), vars) << endl; // d/dy
+        cout << Calculator({ 2, 3, 5, 7 }).calc(Parser(Lexer("a*x^2 + b*y", vars).lex()).parse()) << endl; // 5*4 + 7*3 = 41
+
+        cout << "Testing Tape:" << endl;
+        Tape tape = makeTape("a*x^2 + b*y + sin(x*y)", vars);
+        vector<value_t> at = { value_t(2, 1), 3, 5, 7 };
+        cout << tape.eval(at) << endl;
+        for (const value_t& partial : tape.gradient(at)) {
+            cout << partial << " "; // should match the symbolic partials below
+        }
+        cout << endl;
+        Node* tree = Parser(Lexer("a*x^2 + b*y + sin(x*y)", vars).lex()).parse();
+        for (size_t i = 0; i < vars.size(); ++i) {
+            cout << Calculator(at).calc(diff(tree, i)) << " ";
+        }
+        cout << endl;
+        vector<vector<value_t>> hessian = tape.hessian(at);
+        for (size_t i = 0; i < vars.size(); ++i) {
+            for (size_t j = 0; j < vars.size(); ++j) {
+                cout << hessian[i][j] << " "; // should match row i of the symbolic second partials below
+            }
+            cout << endl;
+            for (size_t j = 0; j < vars.size(); ++j) {
+                cout << Calculator(at).calc(diff(diff(tree, j), i)) << " ";
+            }
+            cout << endl;
+        }
+        cout << makeTape("x^3", DEFAULTVARIABLES).gradient({ 0 })[0] << endl; // 0, the tape handles constant exponents at 0
+        try {
+            tape.hessian({ 1 });
+        } catch (const char* message) {
+            cout << message << endl; // a short point is refused before it is read
+        }
+        try {
+            Calculator(vector<value_t>()).calc(tree);
+        } catch (const char* message) {
+            cout << message << endl;
+        }
+    }
+
+    {
+        cout << "Testing CompiledExpression:" << endl;
+        CompiledExpression compiled("a * x^2 + sin(b * x) + c", { "x" }, { "a", "b", "c" });
+        compiled.setParameter("a", 2);
+        compiled.setParameter("b", 3);
+        compiled.setPoints({ value_t(1, 0), value_t(0.5, 0.5), value_t(-2, 1) });
+        for (const value_t& res : compiled.eval()) {
+            cout << res << " ";
+        }
+        cout << compiled.lastRecomputed() << "/" << compiled.size() << endl; // everything on the first eval
+        compiled.setParameter("c", 10); // only the final sum depends on c
+        for (const value_t& res : compiled.eval()) {
+            cout << res << " ";
+        }
+        cout << compiled.lastRecomputed() << "/" << compiled.size() << endl;
+        compiled.setParameter("b", 1);
+        for (const value_t& res : compiled.eval()) {
+            cout << res << " ";
+        }
+        cout << compiled.lastRecomputed() << "/" << compiled.size() << endl;
+        for (const value_t& x : { value_t(1, 0), value_t(0.5, 0.5), value_t(-2, 1) }) {
+            cout << Calculator(x).calc(Parser(Lexer("2 * x^2 + sin(1 * x) + 10").lex()).parse()) << " "; // should match the line above
+        }
+        cout << endl;
+        CompiledExpression second("a * x^3", { "x" }, { "a" }, 2);
+        second.setParameter("a", 2);
+        second.setPoints({ value_t(2, 2) });
+        cout << second.eval()[0] << endl; // 12 * (2+2i) = (24,24)
+    }
+
+    {
+        cout << "Testing findRoots:" << endl;
+        vector<value_t> starts = { value_t(2, 0), value_t(-1, 1), value_t(-1, -1), value_t(0, 0) };
+        for (RootMethod method : { RootMethod::newton, RootMethod::halley }) {
+            for (const RootResult& r : findRoots("x^3 - 1", starts, method)) { // 1, (-0.5,0.866025), (-0.5,-0.866025), f'(0) = 0 so the last one fails
+                cout << r.root << " " << r.iterations << " " << (r.converged ? "converged" : "failed") << endl;
+            }
+        }
+        vector<value_t> many(1000, value_t(3, 0.5));
+        vector<RootResult> res = findRoots("sin(x)", many, RootMethod::halley, 100, 1e-12, 4);
+        cout << res.front().root << " " << res.back().root << endl; // pi
+    }
+
+    {
+        cout << "Testing Surrogate:" << endl;
+        const auto exact = differentiate("2 * x^3");
+        const auto approx = differentiate("2 * x^3", SurrogateRegion{ RegionShape::rectangle, value_t(0, 0), value_t(3, 3) }, 1e-10);
+        cout << get<0>(approx)({ 2, 2 }) << " " << get<1>(approx)({ 2, 2 }) << " " << get<2>(approx)({ 2, 2 }) << endl; // (-32,32) (0,48) (24,24)
+        cout << get<0>(approx)({ 5, 0 }) << " " << get<0>(exact)({ 5, 0 }) << endl; // outside the region, evaluated exactly
+
+        Surrogate withPole("1 / (x - 0.3)", SurrogateRegion{ RegionShape::disk, value_t(0, 0), value_t(1, 0) }, 1e-8, 6);
+        cout << withPole.exactCellCount() << " exact cells around the pole" << endl;
+        cout << withPole.eval(value_t(-0.5, 0.2), 2) << " " << Calculator(value_t(-0.5, 0.2)).calc(diff(diff(Parser(Lexer("1 / (x - 0.3)").lex()).parse()))) << endl;
+
+        // the branch point of log at -0.5 leaves many small cells whose fit is checked at a few points only
+        Surrogate nearBranch("log(x + 0.5) * sin(x)", SurrogateRegion{ RegionShape::disk, value_t(0, 0), value_t(1, 0) }, 1e-8);
+        Node* tree = Parser(Lexer("log(x + 0.5) * sin(x)").lex()).parse();
+        Node* firstDiffTree = diff(tree);
+        Tape exactTape({ tree, firstDiffTree, diff(firstDiffTree) }, 1);
+        vector<value_t> scratch;
+        size_t missed = 0;
+        for (int i = 0; i < 200; ++i) {
+            for (int j = 0; j < 200; ++j) {
+                value_t x(-1 + (i + 0.5) / 100, -1 + (j + 0.5) / 100);
+                if (abs(x) > 1) continue;
+                for (size_t order = 0; order < 3; ++order) {
+                    value_t y = exactTape.eval(&x, scratch, order);
+                    if (abs(nearBranch.eval(x, order) - y) > 1e-8 * max(1.0, abs(y))) ++missed;
+                }
+            }
+        }
+        cout << missed << " points above the tolerance" << endl; // 0
+    }
+
+    {
+        cout << "Testing precision:" << endl;
+        Node* tree = Parser(Lexer("2 * x^3").lex()).parse();
+        vector<vector<complex<float>>> singleRes = BasicFusedProgram<complex<float>>({ tree, diff(tree) }).evalAll({ { 2, 2 } });
+        cout << singleRes[0][0] << " " << singleRes[1][0] << endl; // (-32,32) (0,48)
+
+        tree = Parser(Lexer("(x + 10000) - 10000").lex()).parse();
+        vector<value_t> points = { value_t(0.001, 0), value_t(3000, 0) };
+        vector<vector<value_t>> mixedRes;
+        size_t reevaluated = MixedPrecisionProgram({ tree }, 1e-4).evalAll(points, mixedRes);
+        cout << BasicFusedProgram<complex<float>>({ tree }).evalAll({ complex<float>(0.001f, 0) })[0][0] << " in float" << endl; // cancellation
+        cout << mixedRes[0][0] << " " << mixedRes[0][1] << " " << reevaluated << " re-evaluated" << endl; // (0.001,0) (3000,0) 1
+        cout << MixedPrecisionProgram({ Parser(Lexer("sin(x) + x").lex()).parse() }, 1e-4).inSingle() << endl; // 0: float would not be faster
+        MixedPrecisionProgram polynomial("x^3 - 2*x + 1", 1e-4);
+        reevaluated = polynomial.evalAll({ value_t(2, 1) }, mixedRes);
+        cout << polynomial.inSingle() << " " << mixedRes[0][0] << " " << mixedRes[1][0] << " " << mixedRes[2][0] << endl; // 1 (-1,9) (7,12) (12,6), all in float
+    }
+
+    {
+        cout << "Testing AdaptiveExpression:" << endl;
+        const auto f = differentiateAdaptive("2 * x^3");
+        cout << get<0>(f)({ 2, 2 }) << " " << get<1>(f)({ 2, 2 }) << " " << get<2>(f)({ 2, 2 }) << endl; // (-32,32) (0,48) (24,24)
+        AdaptiveExpression expression("sin(cos(3*x)) * tan(x)");
+        cout << expression.decision().describe();
+        for (size_t order = 0; order < 3; ++order) {
+            for (size_t s = 0; s < STRATEGYCOUNT; ++s) {
+                cout << expression.evalWith((EvalStrategy)s, value_t(0.3, 0.2), order) << " "; // every strategy agrees
+            }
+            cout << endl;
+        }
+        cout << AdaptiveExpression("log(x + 1) + log(x + 2) + log(x + 3) + log(x + 4)").decision().describe();
+        AdaptiveExpression square("x^2");
+        for (size_t order = 1; order < 3; ++order) {
+            for (size_t s = 0; s < STRATEGYCOUNT; ++s) {
+                try {
+                    cout << square.evalWith((EvalStrategy)s, 0, order) << " ";
+                } catch (const char* e) {
+                    cout << e << " "; // every strategy fails at x = 0 with the same message
+                }
+            }
+            cout << endl;
+        }
+    }
+
+#ifndef _WIN32
+    {
+        cout << "Testing EvalServer:" << endl;
+        signal(SIGPIPE, SIG_IGN);
+        string socketPath = "/tmp/complexDerivatives-test-" + to_string(getpid()) + ".sock";
+        EvalServer server(socketPath);
+        server.start();
+        {
+            EvalClient client(socketPath);
+            vector<value_t> results;
+            client.eval("2 * x^3", 7, { value_t(2, 2) }, results);
+            cout << results[0] << " " << results[1] << " " << results[2] << endl; // (-32,32) (0,48) (24,24) up to rounding
+            client.eval("2 * x^3", 4, { value_t(2, 2), value_t(1, 0) }, results);
+            cout << results[0] << " " << results[1] << endl; // f'' only: (24,24) (12,0)
+            try {
+                client.eval("2 * x^", 1, { value_t(1, 0) }, results);
+            } catch (const char* message) {
+                cout << message << endl; // the parser error, the connection stays usable
+            }
+            client.eval("x + 1", 1, { value_t(1, 0) }, results);
+            cout << results[0] << endl;
+            try {
+                EvalClient(socketPath).eval(string(EvalServer::MAXEXPRESSIONLENGTH + 1, 'x'), 1, { value_t(1, 0) }, results);
+            } catch (const char* message) {
+                cout << message << endl; // refused before the server reads the expression
+            }
+            client.eval("x + 2", 1, { value_t(1, 0) }, results);
+            cout << results[0] << endl; // the other connections are not affected
+            for (size_t k = 0; k < EvalServer::MAXCACHEDEXPRESSIONS + 10; ++k) {
+                client.eval("x + " + to_string(k), 1, { value_t(1, 0) }, results);
+            }
+            client.eval("2 * x^3", 1, { value_t(1, 0) }, results); // evicted, compiled again
+            cout << server.cacheSize() << " " << results[0] << endl; // 1024 (2,0)
+        }
+        server.stop();
+    }
+#endif
+
+    {
+        cout << "Testing deep expressions:" << endl;
+        cout << parseTreeToString(Parser(Lexer(deepExpr("tower", 3)).lex()).parse()) << endl; // right-associative
+        cout << parseTreeToString(Parser(Lexer(deepExpr("parens", 2)).lex()).parse()) << endl;
+        Node* tree = Parser(Lexer(deepExpr("parens", 100000)).lex()).parse();
+        cout << Calculator(value_t(2, 0)).calc(tree) << endl; // the fixed point of y*0.5+1 is 2
+        cout << Tape(diff(tree), 1).eval({ value_t(2, 0) }) << endl; // 0.5^100000 underflows to 0
+        tree = Parser(Lexer(deepExpr("chain", 100000)).lex()).parse();
+        cout << Calculator(value_t(1, 1)).calc(tree) << " " << Calculator(value_t(1, 1)).calc(diff(diff(tree))) << endl; // (50001,50001) (0,0)
+        // every level of f' and f'' shares the levels below it, a tree walk would never finish. The derivatives are products
+        // of 10000 factors below 1 and underflow
+        const auto f = differentiate(deepExpr("functions", 10000));
+        cout << get<0>(f)(value_t(0.5, 0)) << " " << get<1>(f)(value_t(0.5, 0)) << " " << get<2>(f)(value_t(0.5, 0)) << endl;
+    }
+
     return 0;
 }
\ No newline at end of file